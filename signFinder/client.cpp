@@ -0,0 +1,164 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is client.cpp .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+
+
+/*
+ * signClient: sends images to signFinderd, and prints its answers, one line
+ * of JSON per image. See README.daemon.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include "modules/SocketIO.h"
+#include "modules/FileSource.h"
+
+using namespace std;
+
+const char* SOCKET_PATH = "/tmp/signFinder.sock";
+
+enum RequestResult { REQUEST_SENT, REQUEST_UNREADABLE, REQUEST_EMPTY, REQUEST_NOT_SENT };
+
+/**
+ * Sends the request for one file: its absolute path, or with send, its contents.
+ * Empty files are not sent, since the daemon ends the connection on an image of 0 bytes.
+ * @return REQUEST_SENT, or why not: the file can't be read or is empty, or the socket can't be written.
+ */
+RequestResult sendRequest(int fd, const string& file, bool send)
+{
+	if (!send)
+	{
+		char path[PATH_MAX];
+		if (!realpath(file.c_str(), path))
+			return REQUEST_UNREADABLE;
+		return writeLine(fd, string("PATH ") + path) ? REQUEST_SENT : REQUEST_NOT_SENT;
+	}
+
+	ifstream in(file.c_str(), ios::binary);
+	if (!in)
+		return REQUEST_UNREADABLE;
+	vector<char> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+	if (in.bad())
+		return REQUEST_UNREADABLE;
+	if (data.empty())
+		return REQUEST_EMPTY;
+	char header[64];
+	sprintf(header, "IMAGE %lu", (unsigned long) data.size());
+	return writeLine(fd, header) && writeFully(fd, &data[0], data.size()) ? REQUEST_SENT : REQUEST_NOT_SENT;
+}
+
+int main(int argc, char** argv)
+{
+	const char* socketPath = SOCKET_PATH;
+	const char* list = NULL;
+	char separator = '\n';
+	bool send = false;
+	int c;
+	static struct option longOptions[] = {{"list", required_argument, NULL, 'l'}, {NULL, 0, NULL, 0}};
+	while ((c = getopt_long (argc, argv, "s:i0h", longOptions, NULL)) != -1)
+	{
+		switch(c)
+		{
+			case 's':
+				socketPath = optarg;
+			break;
+			case 'i':
+				send = true;
+			break;
+			case '0':
+				separator = '\0';
+			break;
+			case 'l':
+				list = optarg;
+			break;
+			default:
+				cerr << "Usage: " << argv[0] << " [-s socket] [-i] [-0] [--list file] <image-files | ->" << endl;
+				cerr << "See README.daemon for more information." << endl;
+				exit(0);
+		}
+	}
+
+	FileSource files(argv + optind, argc - optind, separator);
+	if (list && !files.setList(list))
+	{
+		cerr << "ERROR: Could not open list " << list << endl;
+		return 1;
+	}
+	int fd = connectUnix(socketPath);
+	if (fd < 0)
+	{
+		cerr << "ERROR: Could not connect to " << socketPath << endl;
+		return 1;
+	}
+	// A daemon that went away fails the write, instead of killing the client.
+	signal(SIGPIPE, SIG_IGN);
+
+	// One request at a time; the answer is printed as soon as it's there.
+	int errors = 0;
+	string file, answer;
+	while (files.next(file))
+	{
+		RequestResult sent = sendRequest(fd, file, send);
+		if (sent == REQUEST_NOT_SENT)
+		{
+			cerr << "ERROR: Could not send " << file << " to signFinderd" << endl;
+			return 1;
+		}
+		if (sent != REQUEST_SENT)
+		{
+			cerr << (sent == REQUEST_EMPTY ? "Skipping empty file " : "Could not read file ") << file << endl;
+			++errors;
+			continue;
+		}
+		if (!readLine(fd, answer, 16 << 20))
+		{
+			cerr << "ERROR: signFinderd closed the connection" << endl;
+			return 1;
+		}
+		cout << answer << endl;
+		if (answer.find("\"status\":\"ok\"") == string::npos)
+			++errors;
+	}
+	close(fd);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,351 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is daemon.cpp .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+
+
+/*
+ * signFinderd: keeps the SignFinder models, and one context with a warm OCR
+ * engine per worker, loaded between requests. Clients connect to a Unix
+ * domain socket, and send the path of an image, or the encoded image itself.
+ * Every request is answered with one line of JSON. See README.daemon.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <deque>
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include "modules/SignFinder.h"
+#include "modules/TestHandler.h"
+#include "modules/ImageLoader.h"
+#include "modules/SocketIO.h"
+
+using namespace std;
+
+const char* SOCKET_PATH = "/tmp/signFinder.sock";
+// Largest encoded image accepted in an IMAGE request.
+const size_t MAX_IMAGE_BYTES = 64 << 20;
+
+SignFinder sf;
+const char* _socketPath = SOCKET_PATH;
+
+/** Milliseconds since the epoch. */
+double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000. + tv.tv_usec / 1000.;
+}
+
+/** Escapes a string for use in JSON, quotes included. */
+string jsonString(const string& in)
+{
+	ostringstream out;
+	out << '"';
+	for (unsigned int i = 0; i < in.size(); ++i)
+	{
+		unsigned char c = in[i];
+		if (c == '"' || c == '\\')
+			out << '\\' << c;
+		else if (c == '\n')
+			out << "\\n";
+		else if (c == '\t')
+			out << "\\t";
+		else if (c < 0x20)
+		{
+			char hex[8];
+			sprintf(hex, "\\u%04x", c);
+			out << hex;
+		}
+		else
+			out << c;
+	}
+	out << '"';
+	return out.str();
+}
+
+/** The answer to a request that failed. */
+string jsonError(const string& error)
+{
+	return "{\"status\":\"error\",\"error\":" + jsonString(error) + "}";
+}
+
+/**
+ * The answer to a request: the signs with their text and corners, in the coordinates of the
+ * image of the request, which is of size frame, and the time spent loading and reading the image, in milliseconds.
+ */
+string jsonSigns(const string& file, CvSize frame, const vector<SignFinder::Sign>& signs, double load, double read)
+{
+	ostringstream out;
+	out << "{\"status\":\"ok\",\"file\":" << jsonString(file);
+	out << ",\"frame\":[" << frame.width << "," << frame.height << "],\"signs\":[";
+	for (unsigned int i = 0; i < signs.size(); ++i)
+	{
+		out << (i ? "," : "") << "{\"text\":" << jsonString(trim(signs[i].text)) << ",\"corners\":[";
+		for (int j = 0; j < 4; ++j)
+			out << (j ? "," : "") << "[" << signs[i].corners[j].x << "," << signs[i].corners[j].y << "]";
+		out << "]}";
+	}
+	out << "],\"timings\":{\"load\":" << load << ",\"read\":" << read << ",\"total\":" << load + read << "}}";
+	return out.str();
+}
+
+/**
+ * Connections that wait for a worker. Bounded: when it's full, no more connections are
+ * accepted, and new clients wait in the backlog of the socket.
+ */
+class ClientQueue
+{
+	public:
+		ClientQueue(int capacity)
+		{
+			_capacity = capacity;
+			pthread_mutex_init(&_lock, NULL);
+			pthread_cond_init(&_notEmpty, NULL);
+			pthread_cond_init(&_notFull, NULL);
+		}
+
+		void push(int fd)
+		{
+			pthread_mutex_lock(&_lock);
+			while ((int) _clients.size() >= _capacity)
+				pthread_cond_wait(&_notFull, &_lock);
+			_clients.push_back(fd);
+			pthread_cond_signal(&_notEmpty);
+			pthread_mutex_unlock(&_lock);
+		}
+
+		int pop()
+		{
+			pthread_mutex_lock(&_lock);
+			while (_clients.empty())
+				pthread_cond_wait(&_notEmpty, &_lock);
+			int fd = _clients.front();
+			_clients.pop_front();
+			pthread_cond_signal(&_notFull);
+			pthread_mutex_unlock(&_lock);
+			return fd;
+		}
+
+	private:
+		int _capacity;
+		deque<int> _clients;
+		pthread_mutex_t _lock;
+		pthread_cond_t _notEmpty, _notFull;
+};
+
+/**
+ * A worker serves one client at a time, until it disconnects, with a context of its own.
+ */
+class Worker
+{
+	public:
+		Worker(ClientQueue& queue) : _queue(queue) {}
+
+		static void* main(void* arg)
+		{
+			((Worker*) arg)->run();
+			return NULL;
+		}
+
+	private:
+		void run()
+		{
+			while (true)
+			{
+				int fd = _queue.pop();
+				serve(fd);
+				close(fd);
+			}
+		}
+
+		/**
+		 * Answers the requests on a connection:
+		 *   PATH <path>\n             reads the image file at path, as seen by the daemon.
+		 *   IMAGE <size>\n<size bytes> reads an encoded image (JPEG, PNG, ...).
+		 */
+		void serve(int fd)
+		{
+			string line;
+			while (readLine(fd, line))
+			{
+				double start = now();
+				string file;
+				IplImage* img = NULL;
+				CvSize frame;
+				if (!line.compare(0, 5, "PATH "))
+				{
+					file = line.substr(5);
+					img = loadImage(file.c_str(), sf.getRes(), CV_LOAD_IMAGE_COLOR, &frame);
+					if (!img && !writeLine(fd, jsonError("Could not load file " + file)))
+						return;
+				}
+				else if (!line.compare(0, 6, "IMAGE "))
+				{
+					size_t size = strtoul(line.c_str() + 6, NULL, 10);
+					if (!size || size > MAX_IMAGE_BYTES)
+					{
+						// The data can't be skipped reliably, so the connection ends here.
+						writeLine(fd, jsonError("Invalid image size in: " + line));
+						return;
+					}
+					if (!readFully(fd, _data, size))
+						return;
+					file = "image";
+					img = decodeImage((const unsigned char*) &_data[0], size, sf.getRes(), CV_LOAD_IMAGE_COLOR, &frame);
+					if (!img && !writeLine(fd, jsonError("Could not decode image")))
+						return;
+				}
+				else if (!writeLine(fd, jsonError("Unknown request: " + line)))
+					return;
+				if (!img)
+					continue;
+
+				// Read from the decoded pixels themselves, without a log: nothing is read or written besides the answer.
+				double loaded = now();
+				ostringstream log;
+				vector<SignFinder::Sign> signs;
+				_ctx.setLog(&log);
+				sf.readSigns(_ctx, (const unsigned char*) img->imageData, img->width, img->height, img->widthStep, signs);
+				_ctx.setLog(&cout);
+
+				// Corners of a reduced JPEG decode back to the full size of the image.
+				if (frame.width != img->width || frame.height != img->height)
+					for (unsigned int i = 0; i < signs.size(); ++i)
+						for (int j = 0; j < 4; ++j)
+						{
+							CvPoint& p = signs[i].corners[j];
+							p = cvPoint(cvRound(p.x * (double) frame.width / img->width), cvRound(p.y * (double) frame.height / img->height));
+						}
+				cvReleaseImage(&img);
+
+				if (!writeLine(fd, jsonSigns(file, frame, signs, loaded - start, now() - loaded)))
+					return;
+			}
+		}
+
+		ClientQueue& _queue;
+		SignFinder::Context _ctx;
+		vector<char> _data;
+};
+
+/** Removes the socket on SIGINT and SIGTERM. */
+void stop(int)
+{
+	unlink(_socketPath);
+	_exit(0);
+}
+
+int main(int argc, char** argv)
+{
+	// Parse command-line parameters
+	int c, threads = 2, backlog = 16, timeout = 30;
+	while ((c = getopt (argc, argv, "s:j:b:t:qvh")) != -1)
+	{
+		switch(c)
+		{
+			case 's':
+				_socketPath = optarg;
+			break;
+			case 'j':
+				threads = atoi(optarg);
+			break;
+			case 'b':
+				backlog = atoi(optarg);
+			break;
+			case 't':
+				timeout = atoi(optarg);
+			break;
+			case 'q':
+				sf.setCornerEngine(SignFinder::CORNERS_QUADFIT);
+			break;
+			case 'v':
+				sf.setDebug(true);
+			break;
+			default:
+				cerr << "Usage: " << argv[0] << " [-s socket] [-j workers] [-b backlog] [-t timeout] [-q] [-v]" << endl;
+				cerr << "See README.daemon for more information." << endl;
+				exit(0);
+		}
+	}
+	threads = MAX(threads, 1);
+	backlog = MAX(backlog, 1);
+	sf.setShowPerformance(false);
+
+	int server = listenUnix(_socketPath, backlog);
+	if (server < 0)
+	{
+		cerr << "ERROR: Could not listen on " << _socketPath << endl;
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	ClientQueue queue(backlog);
+	vector<Worker*> workers;
+	for (int i = 0; i < threads; ++i)
+	{
+		workers.push_back(new Worker(queue));
+		pthread_t thread;
+		pthread_create(&thread, NULL, Worker::main, workers.back());
+		pthread_detach(thread);
+	}
+	cerr << "Listening on " << _socketPath << " with " << threads << " workers." << endl;
+
+	// Accept clients. A client that sends nothing, or doesn't read its answers, is disconnected after the timeout,
+	// so that it doesn't hold a worker.
+	while (true)
+	{
+		int fd = accept(server, NULL, NULL);
+		if (fd < 0)
+			continue;
+		if (timeout > 0)
+		{
+			struct timeval tv = {timeout, 0};
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+			setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		}
+		queue.push(fd);
+	}
+	return 0;
+}
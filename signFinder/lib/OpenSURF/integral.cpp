@@ -20,6 +20,19 @@ IplImage *Integral(IplImage *source)
   IplImage *img = getGray(source);
   IplImage *int_img = cvCreateImage(cvGetSize(img), IPL_DEPTH_32F, 1);
 
+  IntegralInto(img, int_img);
+
+  // release the gray image
+  cvReleaseImage(&img);
+
+  // return the integral image
+  return int_img;
+}
+
+//! Computes the integral image of the single channel 32f image img into
+//! int_img, a 32f image of the same size.
+void IntegralInto(IplImage *img, IplImage *int_img)
+{
   // set up variables for data access
   int height = img->height;
   int width = img->width;
@@ -45,11 +58,4 @@ IplImage *Integral(IplImage *source)
       i_data[i*step+j] = rs + i_data[(i-1)*step+j];
     }
   }
-
-  // release the gray image
-  cvReleaseImage(&img);
-
-  // return the integral image
-  return int_img;
 }
-
@@ -28,6 +28,10 @@
 //! 32-bit floating point.  Returns IplImage in 32-bit float form.
 IplImage *Integral(IplImage *img);
 
+//! Computes the integral image of a single channel 32-bit float image into
+//! an existing 32-bit float image of the same size, so it can be reused.
+void IntegralInto(IplImage *img, IplImage *int_img);
+
 
 //! Computes the sum of pixels within the rectangle specified by the top-left start
 //! co-ordinate and size
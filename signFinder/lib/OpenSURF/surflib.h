@@ -20,8 +20,9 @@
 #include "utils.h"
 
 
-//! Library function builds vector of described interest points
-inline void surfDetDes(IplImage *img,  /* image to find Ipoints in */
+//! Library function builds vector of described interest points, from an
+//! integral image made by Integral or IntegralInto that the caller keeps
+inline void surfDetDesIntegral(IplImage *int_img,  /* integral image to find Ipoints in */
                        std::vector<Ipoint> &ipts, /* reference to vector of Ipoints */
                        bool upright = false, /* run in rotation invariant mode? */
                        int octaves = OCTAVES, /* number of octaves to calculate */
@@ -29,9 +30,6 @@ inline void surfDetDes(IplImage *img,  /* image to find Ipoints in */
                        int init_sample = INIT_SAMPLE, /* initial sampling step */
                        float thres = THRES /* blob response threshold */)
 {
-  // Create integral-image representation of the image
-  IplImage *int_img = Integral(img);
-  
   // Create Fast Hessian Object
   FastHessian fh(int_img, ipts, octaves, intervals, init_sample, thres);
  
@@ -43,6 +41,22 @@ inline void surfDetDes(IplImage *img,  /* image to find Ipoints in */
 
   // Extract the descriptors for the ipts
   des.getDescriptors(upright);
+}
+
+
+//! Library function builds vector of described interest points
+inline void surfDetDes(IplImage *img,  /* image to find Ipoints in */
+                       std::vector<Ipoint> &ipts, /* reference to vector of Ipoints */
+                       bool upright = false, /* run in rotation invariant mode? */
+                       int octaves = OCTAVES, /* number of octaves to calculate */
+                       int intervals = INTERVALS, /* number of intervals per octave */
+                       int init_sample = INIT_SAMPLE, /* initial sampling step */
+                       float thres = THRES /* blob response threshold */)
+{
+  // Create integral-image representation of the image
+  IplImage *int_img = Integral(img);
+  
+  surfDetDesIntegral(int_img, ipts, upright, octaves, intervals, init_sample, thres);
 
   // Deallocate the integral image
   cvReleaseImage(&int_img);
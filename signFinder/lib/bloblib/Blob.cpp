@@ -60,6 +60,8 @@ CBlob::CBlob()
 	mean = 0;
 	stddev = 0;
 	externPerimeter = 0;
+	m_featuresValid = false;
+	m_hull = NULL;
 
 	m_storage = cvCreateMemStorage(0);
 	edges = cvCreateSeq( CV_SEQ_KIND_GENERIC|CV_32SC2,
@@ -107,6 +109,9 @@ CBlob::CBlob( const CBlob &src )
 	mean = src.mean;
 	stddev = src.stddev;
 	externPerimeter = src.externPerimeter;
+	m_features = src.m_features;
+	m_featuresValid = src.m_featuresValid;
+	m_hull = NULL;
 
 	// copiem els edges del blob origen a l'actual
 	CvSeqReader reader;
@@ -150,6 +155,9 @@ CBlob::CBlob( const CBlob *src )
 	mean = src->mean;
 	stddev = src->stddev;
 	externPerimeter = src->externPerimeter;
+	m_features = src->m_features;
+	m_featuresValid = src->m_featuresValid;
+	m_hull = NULL;
 
 	// copiem els edges del blob origen a l'actual
 	CvSeqReader reader;
@@ -260,6 +268,9 @@ CBlob& CBlob::operator=(const CBlob &src )
 		mean = src.mean;
 		stddev = src.stddev;
 		externPerimeter = src.externPerimeter;
+		m_features = src.m_features;
+		m_featuresValid = src.m_featuresValid;
+		m_hull = NULL;
 
 		// copiem els edges del blob origen a l'actual
 		CvSeqReader reader;
@@ -396,6 +407,8 @@ void CBlob::CopyEdges( CBlob &destination ) const
 		
 	cvStartReadSeq( edges, &reader);
 	cvStartAppendToSeq( destination.Edges(), &writer );
+	destination.m_featuresValid = false;
+	destination.m_hull = NULL;
 
 	for( int i=0; i<edges->total; i++)
 	{
@@ -430,6 +443,8 @@ void CBlob::ClearEdges()
 {
 	// Eliminar vrtexs del blob eliminat
 	cvClearSeq( edges );
+	m_featuresValid = false;
+	m_hull = NULL;
 }
 
 /**
@@ -460,7 +475,10 @@ bool CBlob::GetConvexHull( CvSeq **dst ) const
 {
 	if( edges != NULL && edges->total > 0)
 	{
-		*dst = cvConvexHull2( edges, 0, CV_CLOCKWISE, 0 );
+		// computed once, the points of the hull are pointers to the edges
+		if( m_hull == NULL )
+			m_hull = cvConvexHull2( edges, 0, CV_CLOCKWISE, 0 );
+		*dst = m_hull;
 		return true;
 	}
 	return false;
@@ -490,21 +508,76 @@ bool CBlob::GetConvexHull( CvSeq **dst ) const
 */
 CvBox2D CBlob::GetEllipse() const
 {
-	CvBox2D elipse;
+	return Features().ellipse;
+}
+
+/**
+- FUNCTION: Features
+- FUNCTIONALITY: Computes the ellipse, the convex hull and its area and perimeter
+				 once, for all the operators and users of the blob
+- PARAMETERS:
+- RESULT:
+	- the memoised features; they are recomputed after the edges are cleared
+	  or added to
+- RESTRICTIONS:
+	- without edges, the hull area and perimeter are the blob perimeter, as
+	  CBlobGetHullArea and CBlobGetHullPerimeter used to return
+- AUTHOR: Tijs Zwinkels
+- CREATION DATE: 17-10-2009.
+- MODIFICATION: Date. Author. Description.
+*/
+const CBlobFeatures &CBlob::Features() const
+{
+	if( m_featuresValid ) return m_features;
+
+	m_features.area = area;
+	m_features.perimeter = perimeter;
+	m_features.minx = minx;
+	m_features.maxx = maxx;
+	m_features.miny = miny;
+	m_features.maxy = maxy;
+
 	// necessitem 6 punts per calcular l'elipse
 	if( edges != NULL && edges->total > 6)
 	{
-		elipse = cvFitEllipse2( edges );
+		m_features.ellipse = cvFitEllipse2( edges );
+	}
+	else
+	{
+		m_features.ellipse.center.x = 0.0;
+		m_features.ellipse.center.y = 0.0;
+		m_features.ellipse.size.width = 0.0;
+		m_features.ellipse.size.height = 0.0;
+		m_features.ellipse.angle = 0.0;
+	}
+
+	CvSeq *hull;
+	if( GetConvexHull( &hull ) )
+	{
+		// closed polygon length and shoelace area over the hull points
+		double length = 0.0, twiceArea = 0.0;
+		CvPoint pt0 = **CV_GET_SEQ_ELEM( CvPoint*, hull, hull->total - 1 );
+		for( int j = 0; j < hull->total; j++ )
+		{
+			CvPoint pt1 = **CV_GET_SEQ_ELEM( CvPoint*, hull, j );
+			double dx = pt1.x - pt0.x, dy = pt1.y - pt0.y;
+			length += sqrt( dx * dx + dy * dy );
+			twiceArea += (double) pt0.x * pt1.y - (double) pt1.x * pt0.y;
+			pt0 = pt1;
+		}
+		m_features.hullSize = hull->total;
+		m_features.hullPerimeter = length;
+		m_features.hullArea = fabs( twiceArea ) / 2.0;
 	}
 	else
 	{
-		elipse.center.x = 0.0;
-		elipse.center.y = 0.0;
-		elipse.size.width = 0.0;
-		elipse.size.height = 0.0;
-		elipse.angle = 0.0;
+		m_features.hullSize = 0;
+		m_features.hullPerimeter = perimeter;
+		m_features.hullArea = perimeter;
 	}
-	return elipse;
+
+	m_featuresValid = true;
+	return m_features;
 }
 
 
@@ -592,22 +665,12 @@ double CBlobGetMoment::operator()(const CBlob &blob) const
 */
 double CBlobGetHullPerimeter::operator()(const CBlob &blob) const
 {
-	if(blob.Edges() != NULL && blob.Edges()->total > 0)
-	{
-		CvSeq *hull = cvConvexHull2( blob.Edges(), 0, CV_CLOCKWISE, 1 );
-		return fabs(cvArcLength(hull,CV_WHOLE_SEQ,1));
-	}
-	return blob.Perimeter();
+	return blob.Features().hullPerimeter;
 }
 
 double CBlobGetHullArea::operator()(const CBlob &blob) const
 {
-	if(blob.Edges() != NULL && blob.Edges()->total > 0)
-	{
-		CvSeq *hull = cvConvexHull2( blob.Edges(), 0, CV_CLOCKWISE, 1 );
-		return fabs(cvContourArea(hull));
-	}
-	return blob.Perimeter();
+	return blob.Features().hullArea;
 }
 
 /**
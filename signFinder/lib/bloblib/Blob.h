@@ -33,6 +33,26 @@ MODIFICATIONS (Modification, Author, Date):
 
 //! Factor de conversi de graus a radians
 #define DEGREE2RAD		(CV_PI / 180.0)
+
+/**
+	Features of a blob that are costly to compute, see CBlob::Features.
+	Plain data, so the features of a set of blobs can be copied out and
+	classified together.
+*/
+struct CBlobFeatures
+{
+	//! area and perimeter of the blob
+	double area;
+	double perimeter;
+	//! bounding rect
+	double minx, maxx, miny, maxy;
+	//! ellipse fitted to the edges (zero when there are 6 edges or less)
+	CvBox2D ellipse;
+	//! convex hull: number of points, area and perimeter
+	int hullSize;
+	double hullArea;
+	double hullPerimeter;
+};
 /**
 	Classe que representa un blob, ents com un conjunt de pixels del 
 	mateix color contigus en una imatge binaritzada.
@@ -77,6 +97,9 @@ public:
 	//! Calcula l'elipse que s'adapta als vrtexs del blob
 	//! Fits an ellipse to the blob edges
 	CvBox2D GetEllipse() const;
+	//! Ellipse, hull and bounding rect, computed on the first call and kept
+	//! until the edges change
+	const CBlobFeatures &Features() const;
 
 	//! Pinta l'interior d'un blob d'un color determinat
 	//! Paints the blob in an image
@@ -147,6 +170,12 @@ public:
 	//!	Sequncia de punts del contorn del blob
 	//! Sequence with the edges of the blob
 	CvSeq *edges;
+
+	//! Memoised features and convex hull. The hull holds pointers to the edges,
+	//! so it is not carried over when a blob is copied; the features are.
+	mutable CBlobFeatures m_features;
+	mutable bool m_featuresValid;
+	mutable CvSeq *m_hull;
 	
 
 	//! Point datatype for plotting (FillBlob)
@@ -0,0 +1,256 @@
+/************************************************************************
+  			BlobLabeller.cpp
+
+FUNCTIONALITY: Implementation of the CBlobLabeller class
+AUTHOR: Tijs Zwinkels
+MODIFICATIONS (Modification, Author, Date):
+
+**************************************************************************/
+
+#include <algorithm>
+#include "BlobLabeller.h"
+
+CBlobLabeller::CBlobLabeller()
+{
+}
+
+/**
+- FUNCTION: Find
+- FUNCTIONALITY: Root of a provisional label, halving the path on the way
+*/
+int CBlobLabeller::Find( int label )
+{
+	while( m_parent[label] != label )
+	{
+		m_parent[label] = m_parent[m_parent[label]];
+		label = m_parent[label];
+	}
+	return label;
+}
+
+/**
+- FUNCTION: AddRun
+- FUNCTIONALITY: Adds the pixels (xs..xe, y) to the statistics of a component.
+	The sums over the run are in closed form, so the cost is per run, not per pixel.
+*/
+static void AddRun( CBlobLabeller::Component &c, int y, int xs, int xe, int width, int height )
+{
+	double n = xe - xs + 1;
+	double sx = n * ( xs + xe ) / 2.0;
+	// sum of k^2 for k = xs..xe
+	double sxx = ( (double) xe * ( xe + 1 ) * ( 2 * xe + 1 ) - (double) ( xs - 1 ) * xs * ( 2 * xs - 1 ) ) / 6.0;
+
+	c.area += xe - xs + 1;
+	c.sumx += sx;
+	c.sumxx += sxx;
+	c.sumy += n * y;
+	c.sumyy += n * y * y;
+	c.sumxy += sx * y;
+
+	if( xs < c.minx ) c.minx = xs;
+	if( xe > c.maxx ) c.maxx = xe;
+	if( y < c.miny ) c.miny = y;
+	if( y > c.maxy ) c.maxy = y;
+	if( xs == 0 || xe == width - 1 || y == 0 || y == height - 1 )
+		c.exterior = true;
+}
+
+/**
+- FUNCTION: Merge
+- FUNCTIONALITY: Adds the statistics of src to dst, except for the run range
+*/
+static void Merge( CBlobLabeller::Component &dst, const CBlobLabeller::Component &src )
+{
+	dst.area += src.area;
+	dst.sumx += src.sumx;
+	dst.sumxx += src.sumxx;
+	dst.sumy += src.sumy;
+	dst.sumyy += src.sumyy;
+	dst.sumxy += src.sumxy;
+	dst.minx = MIN( dst.minx, src.minx );
+	dst.maxx = MAX( dst.maxx, src.maxx );
+	dst.miny = MIN( dst.miny, src.miny );
+	dst.maxy = MAX( dst.maxy, src.maxy );
+	dst.exterior = dst.exterior || src.exterior;
+}
+
+/**
+- FUNCTION: Label
+- FUNCTIONALITY: Finds the 8-connected components of the pixels above threshold
+- PARAMETERS:
+	- source: 8 bit, single channel image
+	- threshold: pixels with a value above threshold are foreground
+- RESULT:
+	- the number of components
+- RESTRICTIONS:
+	- the runs of every row are matched against those of the row above; touching
+	  runs get the same provisional label, and labels that meet are united with
+	  the lower label as root. Afterwards the provisional labels are folded into
+	  their roots, and the runs are grouped per component by a counting sort.
+*/
+int CBlobLabeller::Label( IplImage *source, unsigned char threshold )
+{
+	m_runs.clear();
+	m_componentRuns.clear();
+	m_parent.clear();
+	m_labels.clear();
+	m_componentOf.clear();
+	m_components.clear();
+
+	const int width = source->width;
+	const int height = source->height;
+	const Component empty = { 0, width, -1, height, -1, 0, 0, 0, 0, 0, false, 0, 0 };
+	int prevBegin = 0, prevEnd = 0;
+
+	for( int y = 0; y < height; y++ )
+	{
+		const unsigned char *row = (const unsigned char *) ( source->imageData + y * source->widthStep );
+		const int rowBegin = (int) m_runs.size();
+		int p = prevBegin;
+		int x = 0;
+
+		while( x < width )
+		{
+			while( x < width && row[x] <= threshold ) x++;
+			if( x == width ) break;
+			const int xs = x;
+			while( x < width && row[x] > threshold ) x++;
+			const int xe = x - 1;
+
+			// runs of the previous row that touch this one, diagonals included
+			while( p < prevEnd && m_runs[p].xe < xs - 1 ) p++;
+			int label = -1;
+			for( int q = p; q < prevEnd && m_runs[q].xs <= xe + 1; q++ )
+			{
+				int other = Find( m_runs[q].label );
+				if( label < 0 )
+					label = other;
+				else if( other != label )
+				{
+					if( other < label ) std::swap( other, label );
+					m_parent[other] = label;
+				}
+			}
+
+			if( label < 0 )
+			{
+				label = (int) m_parent.size();
+				m_parent.push_back( label );
+				m_labels.push_back( empty );
+			}
+
+			Run run = { y, xs, xe, label };
+			m_runs.push_back( run );
+			AddRun( m_labels[label], y, xs, xe, width, height );
+		}
+
+		prevBegin = rowBegin;
+		prevEnd = (int) m_runs.size();
+	}
+
+	// Fold the provisional labels into components. A root is never higher than
+	// the labels below it, so its component exists when they are reached.
+	const int numLabels = (int) m_parent.size();
+	m_componentOf.resize( numLabels );
+	for( int l = 0; l < numLabels; l++ )
+	{
+		int root = Find( l );
+		if( root == l )
+		{
+			m_componentOf[l] = (int) m_components.size();
+			m_components.push_back( m_labels[l] );
+		}
+		else
+		{
+			m_componentOf[l] = m_componentOf[root];
+			Merge( m_components[m_componentOf[root]], m_labels[l] );
+		}
+	}
+
+	// Group the runs per component, keeping the raster order within a component.
+	std::vector<Run>::iterator itRuns;
+	for( itRuns = m_runs.begin(); itRuns != m_runs.end(); itRuns++ )
+		m_components[m_componentOf[itRuns->label]].numRuns++;
+
+	int offset = 0;
+	for( int c = 0; c < (int) m_components.size(); c++ )
+	{
+		m_components[c].firstRun = offset;
+		offset += m_components[c].numRuns;
+		m_components[c].numRuns = 0;
+	}
+
+	m_componentRuns.resize( m_runs.size() );
+	for( itRuns = m_runs.begin(); itRuns != m_runs.end(); itRuns++ )
+	{
+		Component &comp = m_components[m_componentOf[itRuns->label]];
+		m_componentRuns[comp.firstRun + comp.numRuns++] = *itRuns;
+	}
+
+	return (int) m_components.size();
+}
+
+/**
+- FUNCTION: CreateBlob
+- FUNCTIONALITY: Makes a CBlob for one component
+- PARAMETERS:
+	- c: component index, 0 .. GetNumComponents()-1
+- RESULT:
+	- heap allocated blob with the bounding box, normalised moments and the run
+	  edges of the component. The perimeter, mean and stddev are not computed.
+*/
+CBlob *CBlobLabeller::CreateBlob( int c ) const
+{
+	const Component &comp = m_components[c];
+	CBlob *blob = new CBlob();
+
+	blob->etiqueta = c;
+	blob->exterior = comp.exterior;
+	blob->area = comp.area;
+	blob->minx = comp.minx;
+	blob->maxx = comp.maxx + 1;
+	blob->miny = comp.miny;
+	blob->maxy = comp.maxy + 1;
+
+	// Same normalisation as BlobAnalysis
+	blob->sumx = comp.sumx / comp.area;
+	blob->sumy = comp.sumy / comp.area;
+	blob->sumxx = comp.sumxx / comp.area - blob->sumx * blob->sumx;
+	blob->sumyy = comp.sumyy / comp.area - blob->sumy * blob->sumy;
+	blob->sumxy = comp.sumxy / comp.area - blob->sumx * blob->sumy;
+	if( blob->sumxy > -1.0E-14 && blob->sumxy < 1.0E-14 )
+		blob->sumxy = 0.0;
+
+	CvSeqWriter writer;
+	cvStartAppendToSeq( blob->edges, &writer );
+	for( int i = comp.firstRun; i < comp.firstRun + comp.numRuns; i++ )
+	{
+		const Run &run = m_componentRuns[i];
+		CvPoint start = cvPoint( run.xs, run.y );
+		CvPoint end = cvPoint( run.xe + 1, run.y );
+		CV_WRITE_SEQ_ELEM( start, writer );
+		CV_WRITE_SEQ_ELEM( end, writer );
+	}
+	cvEndWriteSeq( &writer );
+
+	return blob;
+}
+
+/**
+- FUNCTION: GetBlobs
+- FUNCTIONALITY: Adds the components that pass the area and border test to dst
+- PARAMETERS:
+	- dst: receives the new blobs
+	- minArea: components with fewer pixels are left out
+	- includeExterior: also add the components that touch the image border
+*/
+void CBlobLabeller::GetBlobs( CBlobResult &dst, double minArea, bool includeExterior ) const
+{
+	for( int c = 0; c < (int) m_components.size(); c++ )
+	{
+		const Component &comp = m_components[c];
+		if( comp.area < minArea || ( comp.exterior && !includeExterior ) )
+			continue;
+		dst.AdoptBlob( CreateBlob( c ) );
+	}
+}
@@ -0,0 +1,92 @@
+/************************************************************************
+  			BlobLabeller.h
+
+FUNCTIONALITY: Definition of the CBlobLabeller class, a run-length connected
+			   component labeller for binary images
+AUTHOR: Tijs Zwinkels
+MODIFICATIONS (Modification, Author, Date):
+
+**************************************************************************/
+
+#ifndef CBLOBLABELLER_INCLUDED
+#define CBLOBLABELLER_INCLUDED
+
+#include <opencv/cxcore.h>
+#include <vector>
+#include "Blob.h"
+#include "BlobResult.h"
+
+/**
+	Labels the foreground (pixels above a threshold) of a binary image, such as
+	the 0/255 output of the histogram matcher, in a single raster scan.
+
+	Runs of foreground pixels are joined with 8-connectivity by union-find, and
+	per component only the area, the bounding box, the first and second order
+	moments and the list of runs are kept, in flat arrays that are reused between
+	images. Unlike BlobAnalysis there is no transition matrix, no perimeter, and
+	the background is not labelled. A CBlob with an edge list is only made for the
+	components that are asked for, see CreateBlob and GetBlobs.
+
+	The CBlob fields follow the BlobAnalysis conventions: minx/miny is the first
+	pixel, maxx/maxy is one past the last pixel, and every run contributes the
+	edges (start, y) and (end + 1, y). Components that touch the image border are
+	marked exterior.
+*/
+class CBlobLabeller
+{
+public:
+	//! Horizontal run of foreground pixels, xe inclusive
+	struct Run
+	{
+		int y;
+		int xs;
+		int xe;
+		int label;
+	};
+
+	//! Statistics of one component
+	struct Component
+	{
+		int area;
+		int minx, maxx, miny, maxy;
+		double sumx, sumy, sumxx, sumyy, sumxy;
+		bool exterior;
+		//! range of the component in the runs sorted per component
+		int firstRun, numRuns;
+	};
+
+	CBlobLabeller();
+
+	//! Labels the image, 8 bit single channel, replacing the previous result
+	int Label( IplImage *source, unsigned char threshold = 0 );
+
+	//! Number of components found by the last call to Label
+	int GetNumComponents() const
+	{
+		return (int) m_components.size();
+	}
+	const Component &GetComponent( int c ) const
+	{
+		return m_components[c];
+	}
+
+	//! New blob for a component, with normalised moments and an edge list. The caller deletes it.
+	CBlob *CreateBlob( int c ) const;
+	//! Adds a blob to dst for every component of at least minArea pixels, leaving out the exterior ones unless asked for
+	void GetBlobs( CBlobResult &dst, double minArea, bool includeExterior = false ) const;
+
+private:
+	int Find( int label );
+
+	//! runs in raster order, and grouped per component
+	std::vector<Run> m_runs;
+	std::vector<Run> m_componentRuns;
+	//! union-find forest and statistics per provisional label
+	std::vector<int> m_parent;
+	std::vector<Component> m_labels;
+	//! component index per provisional label
+	std::vector<int> m_componentOf;
+	std::vector<Component> m_components;
+};
+
+#endif //CBLOBLABELLER_INCLUDED
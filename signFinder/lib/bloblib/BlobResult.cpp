@@ -304,6 +304,23 @@ void CBlobResult::AddBlob( CBlob *blob )
 		m_blobs.push_back( new CBlob( blob ) );
 }
 
+/**
+- FUNCTION: AdoptBlob
+- FUNCTIONALITY: Adds a new blob to the set without copying it
+- PARAMETERS:
+	- blob: heap allocated blob, deleted by this set
+- RESULT:
+- RESTRICTIONS:
+- AUTHOR: Tijs Zwinkels
+- CREATION DATE: 17-10-2009.
+- MODIFICATION: Date. Author. Description.
+*/
+void CBlobResult::AdoptBlob( CBlob *blob )
+{
+	if( blob != NULL )
+		m_blobs.push_back( blob );
+}
+
 
 #ifdef MATRIXCV_ACTIU
 
@@ -619,6 +636,115 @@ void CBlobResult::Filter(CBlobResult &dst,
 	}
 }
 
+/**
+- FUNCTION: Filter
+- FUNCTIONALITY: Keeps the blobs that pass every clause of the filter
+- PARAMETERS:
+	- filter: clauses with the same meaning as the parameters of the other Filter
+- RESULT:
+	- the blobs that fail a clause are deleted, the others keep their order.
+	  Evaluation of a blob stops at the first clause it fails, and the blob
+	  vector is compacted in place, so no blob is copied.
+- RESTRICTIONS:
+- AUTHOR: Tijs Zwinkels
+- CREATION DATE: 17-10-2009.
+- MODIFICATION: Date. Author. Description.
+*/
+void CBlobResult::Filter( const CBlobFilter &filter )
+{
+	blob_vector::iterator itBlobs = m_blobs.begin();
+	blob_vector::iterator itKept = m_blobs.begin();
+
+	for( ; itBlobs != m_blobs.end(); itBlobs++ )
+	{
+		if( filter.Accepts( **itBlobs ) )
+			*itKept++ = *itBlobs;
+		else
+			delete *itBlobs;
+	}
+	m_blobs.erase( itKept, m_blobs.end() );
+}
+
+/**
+- FUNCTION: GetFeatures
+- FUNCTIONALITY: Gets the features of all the blobs, see CBlob::Features
+- PARAMETERS:
+	- dst: replaced by one record per blob
+- RESULT:
+- RESTRICTIONS:
+- AUTHOR: Tijs Zwinkels
+- CREATION DATE: 17-10-2009.
+- MODIFICATION: Date. Author. Description.
+*/
+void CBlobResult::GetFeatures( std::vector<CBlobFeatures> &dst ) const
+{
+	dst.resize( m_blobs.size() );
+	for( unsigned int i = 0; i < m_blobs.size(); i++ )
+		dst[i] = m_blobs[i]->Features();
+}
+
+/**
+- FUNCTION: CBlobFilter::~CBlobFilter
+- FUNCTIONALITY: Deletes the operators of the clauses
+*/
+CBlobFilter::~CBlobFilter()
+{
+	for( unsigned int i = 0; i < m_clauses.size(); i++ )
+		delete m_clauses[i].evaluador;
+}
+
+/**
+- FUNCTION: CBlobFilter::Accepts
+- FUNCTIONALITY: Evaluates the clauses on a blob, in the order they were added
+- RESULT:
+	- false as soon as a clause includes on a false condition, or excludes on a
+	  true one; true if the blob passes all clauses
+*/
+bool CBlobFilter::Accepts( const CBlob &blob ) const
+{
+	for( unsigned int i = 0; i < m_clauses.size(); i++ )
+	{
+		const Clause &clause = m_clauses[i];
+		double value = (*clause.evaluador)( blob );
+		bool resultavaluacio;
+
+		switch( clause.condition )
+		{
+			case B_EQUAL:
+				resultavaluacio = value == clause.lowLimit;
+				break;
+			case B_NOT_EQUAL:
+				resultavaluacio = value != clause.lowLimit;
+				break;
+			case B_GREATER:
+				resultavaluacio = value > clause.lowLimit;
+				break;
+			case B_LESS:
+				resultavaluacio = value < clause.lowLimit;
+				break;
+			case B_GREATER_OR_EQUAL:
+				resultavaluacio = value >= clause.lowLimit;
+				break;
+			case B_LESS_OR_EQUAL:
+				resultavaluacio = value <= clause.lowLimit;
+				break;
+			case B_INSIDE:
+				resultavaluacio = ( value >= clause.lowLimit ) && ( value <= clause.highLimit );
+				break;
+			case B_OUTSIDE:
+				resultavaluacio = ( value < clause.lowLimit ) || ( value > clause.highLimit );
+				break;
+			default:
+				// unknown conditions pass no blob, like the other Filter
+				return false;
+		}
+
+		if( resultavaluacio != ( clause.filterAction == B_INCLUDE ) )
+			return false;
+	}
+	return true;
+}
+
 
 /**
 - FUNCI: GetBlob
@@ -68,6 +68,56 @@ MODIFICATIONS (Modification, Author, Date):
 //! definici de que es un vector de blobs
 typedef std::vector<CBlob*>	blob_vector;
 
+/**
+	Conjunction of filter clauses, each with the meaning of one call to
+	CBlobResult::Filter. CBlobResult::Filter( const CBlobFilter & ) applies all of
+	them in a single pass over the blobs, stopping at the first clause a blob fails,
+	instead of copying the surviving blobs once per clause.
+
+	The clauses keep their own copy of the operator, so temporaries can be passed:
+		CBlobFilter filter;
+		filter.Add( B_EXCLUDE, CBlobGetArea(), B_LESS, minArea )
+		      .Add( B_EXCLUDE, CBlobGetMinX(), B_EQUAL, 0 );
+		blobs.Filter( filter );
+*/
+class CBlobFilter
+{
+public:
+	CBlobFilter() {}
+	~CBlobFilter();
+
+	//! Adds a clause, see CBlobResult::Filter for the actions and conditions
+	template<class Operator>
+	CBlobFilter& Add( int filterAction, const Operator &evaluador, int condition, double lowLimit, double highLimit = 0 )
+	{
+		Clause clause = { filterAction, new Operator( evaluador ), condition, lowLimit, highLimit };
+		m_clauses.push_back( clause );
+		return *this;
+	}
+
+	//! True if the blob passes every clause
+	bool Accepts( const CBlob &blob ) const;
+
+	int GetNumClauses() const
+	{
+		return (int) m_clauses.size();
+	}
+
+private:
+	struct Clause
+	{
+		int filterAction;
+		COperadorBlob *evaluador;
+		int condition;
+		double lowLimit, highLimit;
+	};
+	std::vector<Clause> m_clauses;
+
+	//! The clauses own their operators
+	CBlobFilter( const CBlobFilter & );
+	CBlobFilter& operator=( const CBlobFilter & );
+};
+
 /** 
 	Classe que cont un conjunt de blobs i permet extreure'n propietats 
 	o filtrar-los segons determinats criteris.
@@ -101,6 +151,8 @@ public:
 	//! Afegeix un blob al conjunt
 	//! Adds a blob to the set of blobs
 	void AddBlob( CBlob *blob );
+	//! Adds a blob to the set of blobs without copying it, the set takes ownership
+	void AdoptBlob( CBlob *blob );
 
 #ifdef MATRIXCV_ACTIU
 	//! Calcula un valor sobre tots els blobs de la classe retornant una MatrixCV
@@ -110,6 +162,8 @@ public:
 	//! Calcula un valor sobre tots els blobs de la classe retornant un std::vector<double>
 	//! Computes some property on all the blobs of the class
 	double_stl_vector GetSTLResult( funcio_calculBlob *evaluador ) const;
+	//! Copies the memoised features of all the blobs, in blob order
+	void GetFeatures( std::vector<CBlobFeatures> &dst ) const;
 	
 	//! Calcula un valor sobre un blob de la classe
 	//! Computes some property on one blob of the class
@@ -120,6 +174,8 @@ public:
 	void Filter(CBlobResult &dst,
 				int filterAction, funcio_calculBlob *evaluador, 
 				int condition, double lowLimit, double highLimit = 0 );
+	//! Keeps the blobs that pass all clauses of the filter, in place and without copying them
+	void Filter( const CBlobFilter &filter );
 			
 	//! Retorna l'enssim blob segons un determinat criteri
 	//! Sorts the blobs of the class acording to some criteria and returns the n-th blob
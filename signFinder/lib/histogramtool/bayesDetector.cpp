@@ -0,0 +1,396 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is bayesDetector.cpp .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+#include "bayesDetector.h"
+#include <assert.h>
+#include <string.h>
+
+/** Constructor */
+BayesDetector::BayesDetector()
+{
+	_skinHist = NULL;
+	_nonSkinHist = NULL;
+	_threshold = 0;
+	_colorCode = 1;
+	_compiled = false;
+	memset(_table, 0, sizeof(_table));
+	setKernel(bayesBestKernel());
+}
+
+/**
+ * Select the row kernel of the YCrCb path, see bayesKernels.h.
+ * Unsupported instruction sets fall back to the scalar kernel.
+ */
+void BayesDetector::setKernel(int isa)
+{
+	if (!bayesKernelSupported(isa))
+		isa = BAYES_KERNEL_SCALAR;
+	_kernelIsa = isa;
+	_kernel = bayesKernel(isa);
+}
+
+/**
+ * Compile the histograms into a decision table.
+ * The color codes, channels and ranges are those of the CvMat version of skinDetectBayes.
+ *
+ * @param skinHist, nonSkinHist : 2D histograms of equal dimensions.
+ * @param threshold : decision threshold on skinHist/nonSkinHist.
+ * @param colorCode : 1 = YCrCb, 2 = HSV, 3 = nRGB, 4 = CIE-Lab
+ */
+void BayesDetector::compile(CvHistogram* skinHist, CvHistogram* nonSkinHist, float threshold, int colorCode)
+{
+	assert(skinHist && nonSkinHist);
+	assert(skinHist->mat.dim[0].size == nonSkinHist->mat.dim[0].size);
+	assert(skinHist->mat.dim[1].size == nonSkinHist->mat.dim[1].size);
+
+	_skinHist = skinHist;
+	_nonSkinHist = nonSkinHist;
+	_threshold = threshold;
+	_colorCode = colorCode;
+	_dims[0] = skinHist->mat.dim[0].size;
+	_dims[1] = skinHist->mat.dim[1].size;
+
+	float ranges[2][2] = {{0, 255}, {0, 255}};
+	switch (colorCode)
+	{
+		case 1: // YCrCb
+		case 4: // CIE-Lab
+			_channels[0] = 1; _channels[1] = 2;
+			break;
+		case 2: // HSV
+			_channels[0] = 0; _channels[1] = 1;
+			ranges[0][1] = 180;
+			break;
+		case 3: // nRGB
+			_channels[0] = 0; _channels[1] = 1;
+			ranges[0][1] = 1.0;
+			ranges[1][1] = 1.0;
+			break;
+		default:
+			assert(false && "BayesDetector: unrecognized color-conversion-code");
+	}
+
+	for (int c = 0; c < 2; ++c)
+	{
+		_binsizes[c] = (ranges[c][1] - ranges[c][0]) / (float) _dims[c];
+		// Same rounding as skinDetectBayes: double / float, truncated, top value folded into the last bin.
+		for (int v = 0; v < 256; ++v)
+		{
+			int idx = (int)((double) v / _binsizes[c]);
+			if (idx >= _dims[c])
+				idx = _dims[c] - 1;
+			_binIndex[c][v] = idx;
+		}
+	}
+
+	_compiled = true;
+	build();
+}
+
+/**
+ * Change the decision threshold, and rebuild the table.
+ */
+void BayesDetector::setThreshold(float threshold)
+{
+	_threshold = threshold;
+	if (_compiled)
+		buildDecisions();
+}
+
+/**
+ * Append the compiled detector to out: color code, threshold, bin layout, bin ratios and the decision tables.
+ * loadTables restores it without the histograms.
+ */
+void BayesDetector::saveTables(std::vector<char>& out) const
+{
+	assert(_compiled);
+	const int bins = _dims[0] * _dims[1];
+	const void* parts[] = {&_colorCode, &_threshold, _dims, _channels, _binsizes, _binIndex, &_binRatio[0], &_binDecision[0], _table};
+	const size_t sizes[] = {sizeof(_colorCode), sizeof(_threshold), sizeof(_dims), sizeof(_channels), sizeof(_binsizes), sizeof(_binIndex),
+		bins * sizeof(float), bins * sizeof(uchar), 256 * 256};
+	for (unsigned int i = 0; i < sizeof(parts) / sizeof(parts[0]); ++i)
+		out.insert(out.end(), (const char*) parts[i], (const char*) parts[i] + sizes[i]);
+}
+
+/**
+ * Restore a detector saved by saveTables. Nothing is rebuilt, and no histograms are needed:
+ * the detector can classify, and change its threshold, on the saved tables alone.
+ * @return false if the data doesn't hold a complete detector.
+ */
+bool BayesDetector::loadTables(const char* data, size_t size)
+{
+	const size_t fixed = sizeof(_colorCode) + sizeof(_threshold) + sizeof(_dims) + sizeof(_channels) + sizeof(_binsizes) + sizeof(_binIndex);
+	if (size < fixed)
+		return false;
+	int colorCode, dims[2];
+	memcpy(&colorCode, data, sizeof(colorCode));
+	memcpy(dims, data + sizeof(_colorCode) + sizeof(_threshold), sizeof(dims));
+	if (colorCode < 1 || colorCode > 4 || dims[0] <= 0 || dims[1] <= 0 || dims[0] > 256 || dims[1] > 256)
+		return false;
+	const int bins = dims[0] * dims[1];
+	if (size != fixed + bins * (sizeof(float) + sizeof(uchar)) + 256 * 256)
+		return false;
+
+	_binRatio.resize(bins);
+	_binDecision.resize(bins);
+	void* parts[] = {&_colorCode, &_threshold, _dims, _channels, _binsizes, _binIndex, &_binRatio[0], &_binDecision[0], _table};
+	const size_t sizes[] = {sizeof(_colorCode), sizeof(_threshold), sizeof(_dims), sizeof(_channels), sizeof(_binsizes), sizeof(_binIndex),
+		bins * sizeof(float), bins * sizeof(uchar), 256 * 256};
+	for (unsigned int i = 0; i < sizeof(parts) / sizeof(parts[0]); ++i)
+	{
+		memcpy(parts[i], data, sizes[i]);
+		data += sizes[i];
+	}
+
+	_skinHist = NULL;
+	_nonSkinHist = NULL;
+	_compiled = true;
+	return true;
+}
+
+/**
+ * Fill the decision tables from the histograms and the threshold.
+ */
+void BayesDetector::build()
+{
+	_binRatio.resize(_dims[0] * _dims[1]);
+	for (int i = 0; i < _dims[0]; ++i)
+	{
+		for (int j = 0; j < _dims[1]; ++j)
+		{
+			float skinHistVal = cvQueryHistValue_2D(_skinHist, i, j);
+			float nonSkinHistVal = cvQueryHistValue_2D(_nonSkinHist, i, j);
+			_binRatio[i * _dims[1] + j] = skinHistVal / nonSkinHistVal;
+		}
+	}
+	buildDecisions();
+}
+
+/**
+ * Fill the decision tables from the bin ratios and the threshold.
+ */
+void BayesDetector::buildDecisions()
+{
+	_binDecision.resize(_dims[0] * _dims[1]);
+	for (unsigned int b = 0; b < _binRatio.size(); ++b)
+		_binDecision[b] = (_binRatio[b] >= _threshold) ? 255 : 0;
+
+	for (int v0 = 0; v0 < 256; ++v0)
+	{
+		const uchar* row = &_binDecision[_binIndex[0][v0] * _dims[1]];
+		uchar* dst = _table + (v0 << 8);
+		for (int v1 = 0; v1 < 256; ++v1)
+			dst[v1] = row[_binIndex[1][v1]];
+	}
+}
+
+/**
+ * Classify a BGR image. Equivalent to skinDetectBayes(CvMat*, ...) with the compiled histograms,
+ * threshold and color code, but the color conversion is fused with the classification:
+ * the converted image is never stored, the mask is written one source row at a time.
+ *
+ * @param bgr : IPL_DEPTH_8U, 3 channel BGR image.
+ * @param mask : optional 8U mask, only pixels with value 255 are considered.
+ * @return binary mask, white for the pixels that matched. The caller releases it.
+ */
+IplImage* BayesDetector::detect(IplImage* bgr, IplImage* mask) const
+{
+	IplImage* result = cvCreateImage(cvGetSize(bgr), IPL_DEPTH_8U, 1);
+	detectInto(bgr, result, mask);
+	return result;
+}
+
+/**
+ * As detect, but writes into an existing 8U single channel image of the same size as bgr,
+ * so callers can reuse the buffer between frames.
+ */
+void BayesDetector::detectInto(IplImage* bgr, IplImage* result, IplImage* mask) const
+{
+	assert(_compiled);
+	assert(bgr->depth == IPL_DEPTH_8U && bgr->nChannels == 3);
+	assert(result->width == bgr->width && result->height == bgr->height);
+
+	// The row kernels write every pixel, the other paths only the ones in the mask.
+	if (_colorCode != 1)
+		cvSetZero(result);
+
+	switch (_colorCode)
+	{
+		case 1:
+			detectYCrCb(bgr, mask, result);
+			break;
+		case 3:
+			detectNormalizedRGB(bgr, mask, result);
+			break;
+		default:
+			detectConverted(bgr, mask, result, (_colorCode == 2) ? CV_BGR2HSV : CV_BGR2Lab);
+	}
+}
+
+/**
+ * YCrCb: Cr and Cb are computed from the BGR values with the fixed-point arithmetic of cvCvtColor,
+ * and go straight into the table, by the row kernel selected for this cpu.
+ */
+void BayesDetector::detectYCrCb(IplImage* bgr, IplImage* mask, IplImage* result) const
+{
+	for (int y = 0; y < bgr->height; ++y)
+	{
+		const uchar* src = (const uchar*)(bgr->imageData + y * bgr->widthStep);
+		const uchar* m = mask ? (const uchar*)(mask->imageData + y * mask->widthStep) : NULL;
+		uchar* dst = (uchar*)(result->imageData + y * result->widthStep);
+		_kernel(src, m, dst, bgr->width, _table);
+	}
+}
+
+/**
+ * nRGB: Rn = R / (R+G+B) and Gn = G / (R+G+B) as in bgr2normalizedrgb, looked up in the bin table.
+ */
+void BayesDetector::detectNormalizedRGB(IplImage* bgr, IplImage* mask, IplImage* result) const
+{
+	for (int y = 0; y < bgr->height; ++y)
+	{
+		const uchar* src = (const uchar*)(bgr->imageData + y * bgr->widthStep);
+		const uchar* m = mask ? (const uchar*)(mask->imageData + y * mask->widthStep) : NULL;
+		uchar* dst = (uchar*)(result->imageData + y * result->widthStep);
+
+		for (int x = 0; x < bgr->width; ++x, src += 3)
+		{
+			if (m && m[x] != 255)
+				continue;
+			float rgbSum = (float)src[0] + (float)src[1] + (float)src[2];
+			float rn = 0, gn = 0;
+			if (rgbSum != 0)
+			{
+				rn = src[2] / rgbSum;
+				gn = src[1] / rgbSum;
+			}
+			int i = (int)((double) rn / _binsizes[0]);
+			int j = (int)((double) gn / _binsizes[1]);
+			if (i == _dims[0])
+				i -= 1;
+			if (j == _dims[1])
+				j -= 1;
+			dst[x] = _binDecision[i * _dims[1] + j];
+		}
+	}
+}
+
+/**
+ * HSV and CIE-Lab: the table-driven OpenCV conversions are not worth duplicating here,
+ * so each row is converted by cvCvtColor into a one-row buffer that stays in cache.
+ */
+void BayesDetector::detectConverted(IplImage* bgr, IplImage* mask, IplImage* result, int code) const
+{
+	IplImage* srcRow = cvCreateImageHeader(cvSize(bgr->width, 1), IPL_DEPTH_8U, 3);
+	IplImage* row = cvCreateImage(cvSize(bgr->width, 1), IPL_DEPTH_8U, 3);
+	const int c0 = _channels[0], c1 = _channels[1];
+
+	for (int y = 0; y < bgr->height; ++y)
+	{
+		cvSetData(srcRow, bgr->imageData + y * bgr->widthStep, bgr->widthStep);
+		cvCvtColor(srcRow, row, code);
+
+		const uchar* src = (const uchar*) row->imageData;
+		const uchar* m = mask ? (const uchar*)(mask->imageData + y * mask->widthStep) : NULL;
+		uchar* dst = (uchar*)(result->imageData + y * result->widthStep);
+
+		for (int x = 0; x < bgr->width; ++x, src += 3)
+		{
+			if (m && m[x] != 255)
+				continue;
+			dst[x] = _table[(src[c0] << 8) | src[c1]];
+		}
+	}
+
+	cvReleaseImage(&row);
+	cvReleaseImageHeader(&srcRow);
+}
+
+/**
+ * Histogram bin of every pixel of a BGR image, as the index i * dims[1] + j used by numBins and binRatio.
+ * A pixel is classified positive at threshold t exactly when binRatio(bin) >= t, so the bins describe
+ * the classification at every threshold at once.
+ *
+ * @param bins : IPL_DEPTH_32S, 1 channel image of the size of bgr.
+ */
+void BayesDetector::binsInto(IplImage* bgr, IplImage* bins) const
+{
+	assert(_compiled);
+	assert(bins->depth == IPL_DEPTH_32S && bins->nChannels == 1);
+	assert(bins->width == bgr->width && bins->height == bgr->height);
+
+	IplImage* srcRow = cvCreateImageHeader(cvSize(bgr->width, 1), IPL_DEPTH_8U, 3);
+	IplImage* row = cvCreateImage(cvSize(bgr->width, 1), IPL_DEPTH_8U, 3);
+	const int code = (_colorCode == 1) ? CV_BGR2YCrCb : (_colorCode == 2) ? CV_BGR2HSV : CV_BGR2Lab;
+	const int c0 = _channels[0], c1 = _channels[1];
+
+	for (int y = 0; y < bgr->height; ++y)
+	{
+		int* dst = (int*)(bins->imageData + y * bins->widthStep);
+
+		if (_colorCode == 3)
+		{
+			// nRGB, as detectNormalizedRGB
+			const uchar* src = (const uchar*)(bgr->imageData + y * bgr->widthStep);
+			for (int x = 0; x < bgr->width; ++x, src += 3)
+			{
+				float rgbSum = (float)src[0] + (float)src[1] + (float)src[2];
+				float rn = 0, gn = 0;
+				if (rgbSum != 0)
+				{
+					rn = src[2] / rgbSum;
+					gn = src[1] / rgbSum;
+				}
+				int i = (int)((double) rn / _binsizes[0]);
+				int j = (int)((double) gn / _binsizes[1]);
+				if (i == _dims[0])
+					i -= 1;
+				if (j == _dims[1])
+					j -= 1;
+				dst[x] = i * _dims[1] + j;
+			}
+			continue;
+		}
+
+		cvSetData(srcRow, bgr->imageData + y * bgr->widthStep, bgr->widthStep);
+		cvCvtColor(srcRow, row, code);
+		const uchar* src = (const uchar*) row->imageData;
+		for (int x = 0; x < bgr->width; ++x, src += 3)
+			dst[x] = _binIndex[0][src[c0]] * _dims[1] + _binIndex[1][src[c1]];
+	}
+
+	cvReleaseImage(&row);
+	cvReleaseImageHeader(&srcRow);
+}
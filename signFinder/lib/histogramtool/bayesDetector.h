@@ -0,0 +1,99 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is bayesDetector.h .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+#ifndef BAYESDETECTOR
+#define BAYESDETECTOR
+
+#include <vector>
+#include <opencv/cv.h>
+#include "bayesKernels.h"
+
+/**
+ * Compiled form of the Bayesian histogram matcher (see skinDetectBayes).
+ * The positive and negative histograms, their bin sizes and the decision threshold
+ * are folded into a table once, so classifying a pixel is a single lookup.
+ * The histograms are only read by compile. A compiled detector can be saved with saveTables,
+ * and restored without the histograms with loadTables.
+ */
+class BayesDetector
+{
+	public:
+		BayesDetector();
+
+		void compile(CvHistogram* skinHist, CvHistogram* nonSkinHist, float threshold, int colorCode = 1);
+		void setThreshold(float threshold);
+		float getThreshold() const {return _threshold;}
+		bool isCompiled() const {return _compiled;}
+		void setKernel(int isa);
+
+		IplImage* detect(IplImage* bgr, IplImage* mask = NULL) const;
+		void detectInto(IplImage* bgr, IplImage* result, IplImage* mask = NULL) const;
+
+		int numBins() const {return _dims[0] * _dims[1];}
+		float binRatio(int bin) const {return _binRatio[bin];}
+		void binsInto(IplImage* bgr, IplImage* bins) const;
+
+		void saveTables(std::vector<char>& out) const;
+		bool loadTables(const char* data, size_t size);
+
+	private:
+		void build();
+		void buildDecisions();
+		void detectYCrCb(IplImage* bgr, IplImage* mask, IplImage* result) const;
+		void detectNormalizedRGB(IplImage* bgr, IplImage* mask, IplImage* result) const;
+		void detectConverted(IplImage* bgr, IplImage* mask, IplImage* result, int code) const;
+
+		CvHistogram* _skinHist;
+		CvHistogram* _nonSkinHist;
+		float _threshold;
+		int _colorCode;
+		bool _compiled;
+		int _kernelIsa;
+		BayesRowKernel _kernel;
+
+		int _dims[2];
+		int _channels[2];
+		float _binsizes[2];
+		int _binIndex[2][256];
+
+		// skinHist / nonSkinHist per histogram bin, and the decision on it, 0 or 255.
+		std::vector<float> _binRatio;
+		std::vector<uchar> _binDecision;
+
+		// Decision per 8-bit (channel0, channel1) value pair, 0 or 255.
+		uchar _table[256*256 + BAYES_KERNEL_TABLE_PADDING];
+};
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is bayesKernels.cpp .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+#include "bayesKernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BAYES_X86
+#include <immintrin.h>
+#endif
+
+// cvCvtColor CV_BGR2YCrCb coefficients, scaled by 1 << 14.
+#define YCC_SHIFT 14
+#define YCC_ROUND (1 << (YCC_SHIFT - 1))
+#define YCC_YR 4899
+#define YCC_YG 9617
+#define YCC_YB 1868
+#define YCC_CR 11682
+#define YCC_CB 9241
+
+/**
+ * Reference kernel, also used for the tail of a row by the vector kernels.
+ */
+static void rowScalar(const uchar* bgr, const uchar* mask, uchar* dst, int width, const uchar* table)
+{
+	for (int x = 0; x < width; ++x, bgr += 3)
+	{
+		if (mask && mask[x] != 255)
+		{
+			dst[x] = 0;
+			continue;
+		}
+		int b = bgr[0], g = bgr[1], r = bgr[2];
+		int Y = (b * YCC_YB + g * YCC_YG + r * YCC_YR + YCC_ROUND) >> YCC_SHIFT;
+		int Cr = (((r - Y) * YCC_CR + YCC_ROUND) >> YCC_SHIFT) + 128;
+		int Cb = (((b - Y) * YCC_CB + YCC_ROUND) >> YCC_SHIFT) + 128;
+		Cr = Cr < 0 ? 0 : (Cr > 255 ? 255 : Cr);
+		Cb = Cb < 0 ? 0 : (Cb > 255 ? 255 : Cb);
+		dst[x] = table[(Cr << 8) | Cb];
+	}
+}
+
+#ifdef BAYES_X86
+
+/**
+ * Cr and Cb of 8 pixels, given as 16 bit lanes, packed to 8 bit with saturation.
+ * Y needs 32 bit intermediates, so it goes through madd; the pairs (b,g) and (r,1) multiply
+ * against (YB,YG) and (YR,ROUND). The +128 offset is added after the shift, which is the same
+ * as adding 128 << 14 before it.
+ */
+__attribute__((target("sse2")))
+static inline void crcb8(__m128i b, __m128i g, __m128i r, __m128i& cr, __m128i& cb)
+{
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i kBG = _mm_set1_epi32((YCC_YG << 16) | YCC_YB);
+	const __m128i kR1 = _mm_set1_epi32((YCC_ROUND << 16) | YCC_YR);
+	const __m128i kCr = _mm_set1_epi32((YCC_ROUND << 16) | YCC_CR);
+	const __m128i kCb = _mm_set1_epi32((YCC_ROUND << 16) | YCC_CB);
+	const __m128i offset = _mm_set1_epi16(128);
+
+	__m128i ylo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(b, g), kBG), _mm_madd_epi16(_mm_unpacklo_epi16(r, one), kR1));
+	__m128i yhi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(b, g), kBG), _mm_madd_epi16(_mm_unpackhi_epi16(r, one), kR1));
+	__m128i y = _mm_packs_epi32(_mm_srai_epi32(ylo, YCC_SHIFT), _mm_srai_epi32(yhi, YCC_SHIFT));
+
+	__m128i dr = _mm_sub_epi16(r, y);
+	__m128i db = _mm_sub_epi16(b, y);
+	__m128i crlo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(dr, one), kCr), YCC_SHIFT);
+	__m128i crhi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(dr, one), kCr), YCC_SHIFT);
+	__m128i cblo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(db, one), kCb), YCC_SHIFT);
+	__m128i cbhi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(db, one), kCb), YCC_SHIFT);
+	cr = _mm_add_epi16(_mm_packs_epi32(crlo, crhi), offset);
+	cb = _mm_add_epi16(_mm_packs_epi32(cblo, cbhi), offset);
+}
+
+/**
+ * Look up 16 (Cr,Cb) pairs, given as 8 bit lanes, and apply the mask.
+ */
+__attribute__((target("sse2")))
+static inline void lookup16(__m128i cr, __m128i cb, const uchar* mask, uchar* dst, const uchar* table)
+{
+	unsigned short idx[16] __attribute__((aligned(16)));
+	uchar out[16] __attribute__((aligned(16)));
+	_mm_store_si128((__m128i*) idx, _mm_unpacklo_epi8(cb, cr));
+	_mm_store_si128((__m128i*) (idx + 8), _mm_unpackhi_epi8(cb, cr));
+	for (int i = 0; i < 16; ++i)
+		out[i] = table[idx[i]];
+
+	__m128i v = _mm_load_si128((const __m128i*) out);
+	if (mask)
+		v = _mm_and_si128(v, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) mask), _mm_set1_epi8((char)255)));
+	_mm_storeu_si128((__m128i*) dst, v);
+}
+
+/**
+ * SSE2 has no byte shuffle, so the deinterleave is scalar; the arithmetic is vectorised.
+ */
+__attribute__((target("sse2")))
+static void rowSSE2(const uchar* bgr, const uchar* mask, uchar* dst, int width, const uchar* table)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		uchar pb[16] __attribute__((aligned(16)));
+		uchar pg[16] __attribute__((aligned(16)));
+		uchar pr[16] __attribute__((aligned(16)));
+		const uchar* src = bgr + 3 * x;
+		for (int i = 0; i < 16; ++i)
+		{
+			pb[i] = src[3 * i];
+			pg[i] = src[3 * i + 1];
+			pr[i] = src[3 * i + 2];
+		}
+		__m128i b = _mm_load_si128((const __m128i*) pb);
+		__m128i g = _mm_load_si128((const __m128i*) pg);
+		__m128i r = _mm_load_si128((const __m128i*) pr);
+
+		__m128i crlo, cblo, crhi, cbhi;
+		crcb8(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(r, zero), crlo, cblo);
+		crcb8(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(r, zero), crhi, cbhi);
+		lookup16(_mm_packus_epi16(crlo, crhi), _mm_packus_epi16(cblo, cbhi), mask ? mask + x : NULL, dst + x, table);
+	}
+	rowScalar(bgr + 3 * x, mask ? mask + x : NULL, dst + x, width - x, table);
+}
+
+/**
+ * Split 16 packed BGR pixels (48 bytes) into B, G and R planes with byte shuffles.
+ */
+__attribute__((target("ssse3")))
+static inline void deinterleave16(const uchar* src, __m128i& b, __m128i& g, __m128i& r)
+{
+	__m128i s0 = _mm_loadu_si128((const __m128i*) src);
+	__m128i s1 = _mm_loadu_si128((const __m128i*) (src + 16));
+	__m128i s2 = _mm_loadu_si128((const __m128i*) (src + 32));
+
+	b = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(s0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(s1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(s2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+	g = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(s0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(s1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(s2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+	r = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(s0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(s1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(s2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+__attribute__((target("sse4.1")))
+static void rowSSE41(const uchar* bgr, const uchar* mask, uchar* dst, int width, const uchar* table)
+{
+	int x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i b, g, r;
+		deinterleave16(bgr + 3 * x, b, g, r);
+
+		__m128i crlo, cblo, crhi, cbhi;
+		crcb8(_mm_cvtepu8_epi16(b), _mm_cvtepu8_epi16(g), _mm_cvtepu8_epi16(r), crlo, cblo);
+		crcb8(_mm_cvtepu8_epi16(_mm_srli_si128(b, 8)), _mm_cvtepu8_epi16(_mm_srli_si128(g, 8)),
+			_mm_cvtepu8_epi16(_mm_srli_si128(r, 8)), crhi, cbhi);
+		lookup16(_mm_packus_epi16(crlo, crhi), _mm_packus_epi16(cblo, cbhi), mask ? mask + x : NULL, dst + x, table);
+	}
+	rowScalar(bgr + 3 * x, mask ? mask + x : NULL, dst + x, width - x, table);
+}
+
+/**
+ * 256 bit version of crcb8, for 16 pixels. The unpack/pack pairs work per 128 bit lane,
+ * and cancel out, so the pixel order is preserved.
+ */
+__attribute__((target("avx2")))
+static inline __m256i crcbIndex16(__m256i b, __m256i g, __m256i r)
+{
+	const __m256i one = _mm256_set1_epi16(1);
+	const __m256i kBG = _mm256_set1_epi32((YCC_YG << 16) | YCC_YB);
+	const __m256i kR1 = _mm256_set1_epi32((YCC_ROUND << 16) | YCC_YR);
+	const __m256i kCr = _mm256_set1_epi32((YCC_ROUND << 16) | YCC_CR);
+	const __m256i kCb = _mm256_set1_epi32((YCC_ROUND << 16) | YCC_CB);
+	const __m256i offset = _mm256_set1_epi16(128);
+	const __m256i lo = _mm256_setzero_si256(), hi = _mm256_set1_epi16(255);
+
+	__m256i ylo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(b, g), kBG), _mm256_madd_epi16(_mm256_unpacklo_epi16(r, one), kR1));
+	__m256i yhi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(b, g), kBG), _mm256_madd_epi16(_mm256_unpackhi_epi16(r, one), kR1));
+	__m256i y = _mm256_packs_epi32(_mm256_srai_epi32(ylo, YCC_SHIFT), _mm256_srai_epi32(yhi, YCC_SHIFT));
+
+	__m256i dr = _mm256_sub_epi16(r, y);
+	__m256i db = _mm256_sub_epi16(b, y);
+	__m256i crlo = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(dr, one), kCr), YCC_SHIFT);
+	__m256i crhi = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(dr, one), kCr), YCC_SHIFT);
+	__m256i cblo = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(db, one), kCb), YCC_SHIFT);
+	__m256i cbhi = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(db, one), kCb), YCC_SHIFT);
+	__m256i cr = _mm256_add_epi16(_mm256_packs_epi32(crlo, crhi), offset);
+	__m256i cb = _mm256_add_epi16(_mm256_packs_epi32(cblo, cbhi), offset);
+	cr = _mm256_min_epi16(_mm256_max_epi16(cr, lo), hi);
+	cb = _mm256_min_epi16(_mm256_max_epi16(cb, lo), hi);
+
+	return _mm256_or_si256(_mm256_slli_epi16(cr, 8), cb);
+}
+
+/**
+ * Gather the table entries for 16 indices, given as 16 bit lanes, into 16 bytes.
+ * Every gathered dword holds the entry in its low byte and is either 0 or 255 there.
+ */
+__attribute__((target("avx2")))
+static inline __m128i gather16(__m256i idx, const uchar* table)
+{
+	const __m256i low = _mm256_set1_epi32(0xff);
+	__m256i v0 = _mm256_and_si256(_mm256_i32gather_epi32((const int*) table, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(idx)), 1), low);
+	__m256i v1 = _mm256_and_si256(_mm256_i32gather_epi32((const int*) table, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(idx, 1)), 1), low);
+	__m256i w = _mm256_permute4x64_epi64(_mm256_packus_epi32(v0, v1), 0xD8);
+	return _mm_packus_epi16(_mm256_castsi256_si128(w), _mm256_extracti128_si256(w, 1));
+}
+
+__attribute__((target("avx2")))
+static void rowAVX2(const uchar* bgr, const uchar* mask, uchar* dst, int width, const uchar* table)
+{
+	const __m128i full = _mm_set1_epi8((char)255);
+	int x = 0;
+	for (; x + 32 <= width; x += 32)
+	{
+		for (int half = 0; half < 32; half += 16)
+		{
+			__m128i b, g, r;
+			deinterleave16(bgr + 3 * (x + half), b, g, r);
+			__m128i v = gather16(crcbIndex16(_mm256_cvtepu8_epi16(b), _mm256_cvtepu8_epi16(g), _mm256_cvtepu8_epi16(r)), table);
+			if (mask)
+				v = _mm_and_si128(v, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (mask + x + half)), full));
+			_mm_storeu_si128((__m128i*) (dst + x + half), v);
+		}
+	}
+	rowScalar(bgr + 3 * x, mask ? mask + x : NULL, dst + x, width - x, table);
+}
+
+#endif
+
+/**
+ * @return the kernel for the given instruction set, or NULL if it is not compiled in.
+ */
+BayesRowKernel bayesKernel(int isa)
+{
+	switch (isa)
+	{
+		case BAYES_KERNEL_SCALAR: return rowScalar;
+#ifdef BAYES_X86
+		case BAYES_KERNEL_SSE2: return rowSSE2;
+		case BAYES_KERNEL_SSE41: return rowSSE41;
+		case BAYES_KERNEL_AVX2: return rowAVX2;
+#endif
+	}
+	return NULL;
+}
+
+/**
+ * @return whether the kernel is compiled in, and the cpu supports it.
+ */
+bool bayesKernelSupported(int isa)
+{
+	if (!bayesKernel(isa))
+		return false;
+#ifdef BAYES_X86
+	__builtin_cpu_init();
+	switch (isa)
+	{
+		case BAYES_KERNEL_SSE2: return __builtin_cpu_supports("sse2");
+		case BAYES_KERNEL_SSE41: return __builtin_cpu_supports("sse4.1");
+		case BAYES_KERNEL_AVX2: return __builtin_cpu_supports("avx2");
+	}
+#endif
+	return true;
+}
+
+/**
+ * @return the fastest kernel the cpu supports.
+ */
+int bayesBestKernel()
+{
+	for (int isa = BAYES_KERNEL_COUNT - 1; isa > BAYES_KERNEL_SCALAR; --isa)
+		if (bayesKernelSupported(isa))
+			return isa;
+	return BAYES_KERNEL_SCALAR;
+}
+
+const char* bayesKernelName(int isa)
+{
+	static const char* names[] = {"scalar", "sse2", "sse4.1", "avx2"};
+	if (isa < 0 || isa >= BAYES_KERNEL_COUNT)
+		return "unknown";
+	return names[isa];
+}
@@ -0,0 +1,67 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is bayesKernels.h .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+#ifndef BAYESKERNELS
+#define BAYESKERNELS
+
+#include <opencv/cxcore.h>
+
+/**
+ * Row kernels for the YCrCb path of BayesDetector.
+ * A kernel converts one row of BGR pixels to Cr and Cb with the fixed-point arithmetic of cvCvtColor,
+ * looks the (Cr,Cb) pair up in a 256x256 decision table and writes 0 or 255 per pixel.
+ * Pixels with a mask value other than 255 are written as 0. All variants produce identical output.
+ */
+
+enum BayesKernelIsa
+{
+	BAYES_KERNEL_SCALAR = 0,
+	BAYES_KERNEL_SSE2,
+	BAYES_KERNEL_SSE41,
+	BAYES_KERNEL_AVX2,
+	BAYES_KERNEL_COUNT
+};
+
+// The AVX2 kernel reads the table with 32 bit gathers, so tables need this many readable bytes past the end.
+#define BAYES_KERNEL_TABLE_PADDING 4
+
+typedef void (*BayesRowKernel)(const uchar* bgr, const uchar* mask, uchar* dst, int width, const uchar* table);
+
+BayesRowKernel bayesKernel(int isa);
+bool bayesKernelSupported(int isa);
+int bayesBestKernel();
+const char* bayesKernelName(int isa);
+
+#endif
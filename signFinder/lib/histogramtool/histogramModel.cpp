@@ -0,0 +1,179 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is histogramModel.cpp .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+#include "histogramModel.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+
+static const char MAGIC[4] = {'S', 'F', 'H', 'M'};
+
+/**
+ * FNV-1a hash of a block of memory.
+ */
+unsigned int HistogramModel::checksum(const void* data, size_t size, unsigned int hash)
+{
+	const unsigned char* p = (const unsigned char*) data;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ p[i]) * 16777619u;
+	return hash;
+}
+
+/** Constructor */
+HistogramModel::HistogramModel()
+{
+	_data = NULL;
+	_size = 0;
+	_header = NULL;
+}
+
+/** Destructor */
+HistogramModel::~HistogramModel()
+{
+	close();
+}
+
+/**
+ * Map a model file, and check it.
+ * @return false if the file can't be mapped, or is not a valid model of this version.
+ */
+bool HistogramModel::open(const char* filename)
+{
+	close();
+
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(Header))
+	{
+		::close(fd);
+		return false;
+	}
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	// Check the header, the size and the bins.
+	const Header* header = (const Header*) data;
+	size_t bins = 0;
+	bool ok = !memcmp(header->magic, MAGIC, sizeof(MAGIC)) && header->version == HISTOGRAM_MODEL_VERSION
+		&& header->colorCode >= 1 && header->colorCode <= 4
+		&& header->dims[0] > 0 && header->dims[1] > 0 && header->dims[0] <= 4096 && header->dims[1] <= 4096;
+	if (ok)
+	{
+		bins = (size_t) header->dims[0] * header->dims[1];
+		ok = (size_t) st.st_size == sizeof(Header) + 2 * bins * sizeof(float)
+			&& checksum((const char*) data + sizeof(Header), 2 * bins * sizeof(float)) == header->checksum;
+	}
+	if (!ok)
+	{
+		fprintf(stderr, "ERROR: %s is not a valid histogram model (version %d).\n", filename, HISTOGRAM_MODEL_VERSION);
+		munmap(data, st.st_size);
+		return false;
+	}
+
+	_data = data;
+	_size = st.st_size;
+	_header = header;
+
+	// Histogram headers over the mapped bins, without ranges, like the histograms of loadHistogram.
+	// OpenCV doesn't write to them as long as we don't.
+	float* pos = (float*)((char*) data + sizeof(Header));
+	float* neg = pos + bins;
+	int dims[2] = {header->dims[0], header->dims[1]};
+	cvMakeHistHeaderForArray(2, dims, &_pos, pos);
+	cvMakeHistHeaderForArray(2, dims, &_neg, neg);
+	return true;
+}
+
+/**
+ * Unmap the model. The histograms are no longer valid afterwards.
+ */
+void HistogramModel::close()
+{
+	if (_data)
+		munmap(_data, _size);
+	_data = NULL;
+	_size = 0;
+	_header = NULL;
+}
+
+/**
+ * Write two 2D histograms of equal dimensions as a model file.
+ * @param colorCode : the color space the histograms were made in, see BayesDetector::compile.
+ */
+bool HistogramModel::write(const char* filename, CvHistogram* posHist, CvHistogram* negHist, int colorCode)
+{
+	if (!posHist || !negHist || posHist->mat.dim[0].size != negHist->mat.dim[0].size || posHist->mat.dim[1].size != negHist->mat.dim[1].size)
+		return false;
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = HISTOGRAM_MODEL_VERSION;
+	header.colorCode = colorCode;
+	header.dims[0] = posHist->mat.dim[0].size;
+	header.dims[1] = posHist->mat.dim[1].size;
+	// The channel ranges of the color code, as in BayesDetector::compile.
+	header.ranges[0][1] = header.ranges[1][1] = 255;
+	if (colorCode == 2) // HSV
+		header.ranges[0][1] = 180;
+	else if (colorCode == 3) // nRGB
+		header.ranges[0][1] = header.ranges[1][1] = 1.0;
+
+	// Copy the bins, whatever the layout of the histograms.
+	std::vector<float> bins(2 * header.dims[0] * header.dims[1]);
+	float* pos = &bins[0];
+	float* neg = pos + header.dims[0] * header.dims[1];
+	for (int i = 0; i < header.dims[0]; ++i)
+		for (int j = 0; j < header.dims[1]; ++j)
+		{
+			pos[i * header.dims[1] + j] = cvQueryHistValue_2D(posHist, i, j);
+			neg[i * header.dims[1] + j] = cvQueryHistValue_2D(negHist, i, j);
+		}
+	header.checksum = checksum(&bins[0], bins.size() * sizeof(float));
+
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+		return false;
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(&bins[0], sizeof(float), bins.size(), f) == bins.size();
+	return (fclose(f) == 0) && ok;
+}
@@ -0,0 +1,91 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is histogramModel.h .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+#ifndef HISTOGRAMMODEL
+#define HISTOGRAMMODEL
+
+#include <opencv/cv.h>
+
+#define HISTOGRAM_MODEL_VERSION 1
+
+/**
+ * Binary file with the positive and negative color histograms of the histogram matcher,
+ * as an alternative to the XML files of writeHistogram / loadHistogram.
+ *
+ * The file is a Header, followed by the positive and the negative bins as floats, row-major.
+ * It is memory-mapped read-only, and the histograms are headers over the mapped bins,
+ * so loading is a few page faults instead of XML parsing, and processes that load the
+ * same model share its pages. The histograms are owned by the model and stay valid until
+ * close(); they must not be modified or released with cvReleaseHist.
+ */
+class HistogramModel
+{
+	public:
+		struct Header
+		{
+			char magic[4];		// "SFHM"
+			unsigned int version;	// HISTOGRAM_MODEL_VERSION
+			int colorCode;		// as BayesDetector::compile
+			int dims[2];
+			float ranges[2][2];	// channel ranges of the color code
+			unsigned int checksum;	// FNV-1a over the bins
+			unsigned int reserved;
+		};
+
+		HistogramModel();
+		~HistogramModel();
+
+		bool open(const char* filename);
+		void close();
+		bool isOpen() const {return _data != NULL;}
+
+		CvHistogram* posHist() {return isOpen() ? &_pos : NULL;}
+		CvHistogram* negHist() {return isOpen() ? &_neg : NULL;}
+		int colorCode() const {return _header->colorCode;}
+
+		static bool write(const char* filename, CvHistogram* posHist, CvHistogram* negHist, int colorCode = 1);
+		static unsigned int checksum(const void* data, size_t size, unsigned int hash = 2166136261u);
+
+	private:
+		void* _data;
+		size_t _size;
+		const Header* _header;
+		CvHistogram _pos, _neg;
+
+		HistogramModel(const HistogramModel&);
+		HistogramModel& operator=(const HistogramModel&);
+};
+
+#endif
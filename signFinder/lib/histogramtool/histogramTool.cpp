@@ -408,6 +408,8 @@ void writeHistogram(CvHistogram * hist, char* filename)
 CvHistogram* loadHistogram(char* filename)
 {
 	CvMatND* bins = (CvMatND*) cvLoad(filename);
+	if (!bins)
+		return NULL;
 
 	int dims[] = {bins->dim[0].size, bins->dim[1].size};
 	
@@ -420,6 +422,7 @@ CvHistogram* loadHistogram(char* filename)
 			*((float*)cvPtr2D( (hist)->bins, i, j, 0 ))	= (float) cvGet2D(bins, i, j).val[0];
 		}
 	}
+	cvReleaseMatND(&bins);
 	return hist;
 }
 
@@ -550,6 +553,44 @@ void bgr2normalizedrgb(IplImage* src_, IplImage* dst_)
 	}
 }
 
+/* Counts the positive and the negative Cr/Cb histogram of an image in a single pass, as
+ * calculateHistogram(in, mask, dim, 1) and calculateHistogram(in, NOT mask, dim, 1) would.
+ * Every pixel is converted to YCrCb once, and is counted in pos if its mask byte is not 0,
+ * and in neg if its mask byte is not 255 (as the inverted mask would be non-zero there).
+ * The counts are added to pos and neg, dim*dim integer bins in (Cr, Cb) order,
+ * so that they stay exact where float histogram bins would stop counting at 2^24.
+ * Like cvCalcHist on the range [0,255], a channel value v falls in bin v*dim/255,
+ * and pixels with a channel value of 255 fall outside the range and are not counted.
+ */
+void countHistogramsYCrCb(IplImage* in_, IplImage* mask_, int dim, unsigned int* pos, unsigned int* neg)
+{
+	int binIndex[256];
+	for (int v = 0; v < 256; ++v)
+		binIndex[v] = (v * dim) / 255;
+
+	IplImage* ycrcb = cvCreateImage(cvGetSize(in_), IPL_DEPTH_8U, 3);
+	cvCvtColor(in_, ycrcb, CV_BGR2YCrCb);
+
+	for (int y = 0; y < ycrcb->height; ++y)
+	{
+		const uchar* src = (const uchar*)(ycrcb->imageData + y * ycrcb->widthStep);
+		const uchar* m = (const uchar*)(mask_->imageData + y * mask_->widthStep);
+		for (int x = 0; x < ycrcb->width; ++x, src += 3)
+		{
+			int i = binIndex[src[1]];
+			int j = binIndex[src[2]];
+			if (i >= dim || j >= dim)
+				continue;
+			if (m[x] != 0)
+				++pos[i * dim + j];
+			if (m[x] != 255)
+				++neg[i * dim + j];
+		}
+	}
+
+	cvReleaseImage(&ycrcb);
+}
+
 CvHistogram* calculateNegHistogram(CvMat* in_, CvMat* mask, int dim, int code)
 {
 	// Tijs hack
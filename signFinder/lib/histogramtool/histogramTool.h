@@ -40,6 +40,7 @@ IplImage* convertCvMatToIpl(CvMat* in_, int depth_, int channels_);
 CvHistogram* calculateHistogram(IplImage* in_, IplImage* mask_, int dim, int code);
 CvHistogram* calculateHistogram(CvMat* in_, CvMat* mask, int dim, int code);
 CvHistogram* calculateNegHistogram(CvMat* in_, CvMat* mask, int dim, int code);
+void countHistogramsYCrCb(IplImage* in_, IplImage* mask_, int dim, unsigned int* pos, unsigned int* neg);
 
 CvHistogram* calculateHistogram(CvMat* in_, CvMat* mask_, int* cois_, int dim_, int code_, float** ranges);
 CvHistogram* calculateHistogram(IplImage* in_, IplImage* mask_, int* cois_, int dim_, int code_, float** ranges);
@@ -34,32 +34,114 @@
  */
 
 #include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
 #include "modules/SignFinder.h"
+#include "modules/WorkQueue.h"
+#include "modules/Prefetcher.h"
 
 const int WINDOWX = 1024;
 const int WINDOWY = 768;
 
-int _curFile = 0;
-
 SignFinder sf;
 bool window=true, saveImage=true;
 
 /**
- *  Try to read the streetsigns in the image with the SignFinder library,
- *  and print the text on the streetsign to stdout
+ * One input file, on its way through the worker pool.
  */
-void processFile(char* file)
+struct Job
 {
-		IplImage* vis = cvCreateImage(cvSize(1600,1200), IPL_DEPTH_8U,3);
-                string result = sf.readSigns(file,vis);
-                cout << file << ":" << endl << result ; 
-                string resultfile(file);
-		if (saveImage)
-                	cvSaveImage((resultfile+"_result.jpg").c_str(),vis);
-		if (window)
-			cvShowImage("signFinder",vis);
-                cvReleaseImage(&vis);
-}
+	string file;
+	Prefetcher::Item* item;
+	IplImage* vis;
+	string result;
+	ostringstream log;
+};
+
+/**
+ *  Reads the streetsigns of all files on the command line, on a pool of worker threads.
+ *  All workers use the global SignFinder, each with its own context. The performance metrics
+ *  of the contexts are merged back into it at the end. Output is printed in the order of the command line.
+ *  The files, with their labels, are loaded ahead by the prefetcher.
+ */
+class BatchQueue : public WorkQueue
+{
+	public:
+		BatchQueue(int threads, Prefetcher& prefetch) : WorkQueue(threads), _prefetch(prefetch)
+		{
+			for (int i = 0; i < numThreads(); ++i)
+				_contexts.push_back(new SignFinder::Context);
+		}
+
+		~BatchQueue()
+		{
+			for (unsigned int i = 0; i < _contexts.size(); ++i)
+			{
+				sf.mergePerformance(*_contexts[i]);
+				delete _contexts[i];
+			}
+		}
+
+	protected:
+		void* produce()
+		{
+			Prefetcher::Item* item = _prefetch.next();
+			if (!item)
+				return NULL;
+			Job* job = new Job;
+			job->item = item;
+			job->file = item->file;
+			return job;
+		}
+
+		/**
+		 *  Try to read the streetsigns in the image with the SignFinder library.
+		 */
+		void process(void* j, int worker)
+		{
+			Job* job = (Job*) j;
+			SignFinder::Context* ctx = _contexts[worker];
+			_prefetch.fetch(job->item);
+			// The result image is of the size the image is processed at, which detector.model may set.
+			// Without an image, readImage reports the file and stops.
+			CvSize size = sf.getRes();
+			if ((!size.width || !size.height) && job->item->image)
+				size = cvGetSize(job->item->image);
+			job->vis = job->item->image ? cvCreateImage(size, IPL_DEPTH_8U,3) : NULL;
+			ctx->setLog(&job->log);
+			ctx->setLabels(&job->item->labels);
+			job->result = sf.readImage(*ctx,(char*) job->file.c_str(),job->item->image,job->vis);
+			ctx->setLabels(NULL);
+			ctx->setLog(&cout);
+			_prefetch.release(job->item);
+
+			string resultfile(job->file);
+			if (saveImage)
+				cvSaveImage((resultfile+"_result.jpg").c_str(),job->vis);
+		}
+
+		/**
+		 *  Print the text on the streetsign to stdout, and show the result.
+		 */
+		void consume(void* j)
+		{
+			Job* job = (Job*) j;
+			cout << job->log.str() << job->file << ":" << endl << job->result << flush;
+			if (window)
+			{
+				cvShowImage("signFinder",job->vis);
+				cvWaitKey(20);
+			}
+			cvReleaseImage(&job->vis);
+			delete job;
+		}
+
+	private:
+		Prefetcher& _prefetch;
+		vector<SignFinder::Context*> _contexts;
+};
 
 int main(int argc, char** argv)
 {
@@ -71,8 +153,15 @@ int main(int argc, char** argv)
         }
 
 	// Parse command-line parameters
-	int c;
-	while ((c = getopt (argc, argv, "vwps")) != -1)
+	int c, threads = 1, depth = 4, budget = 256;
+	char separator = '\n';
+	const char* list = NULL;
+	const char* compile = NULL;
+	double threshold = -1;
+	SignFinder::BlobBounds bounds;
+	bool setBounds = false;
+	static struct option longOptions[] = {{"list", required_argument, NULL, 'l'}, {NULL, 0, NULL, 0}};
+	while ((c = getopt_long (argc, argv, "vwpsqj:k:m:0c:t:b:", longOptions, NULL)) != -1)
 	{
 		switch(c)
 		{
@@ -88,9 +177,64 @@ int main(int argc, char** argv)
 			case 's':
 				saveImage = false;
 			break;
+			case 'q':
+				sf.setCornerEngine(SignFinder::CORNERS_QUADFIT);
+			break;
+			case 'j':
+				threads = atoi(optarg);
+			break;
+			case 'k':
+				depth = atoi(optarg);
+			break;
+			case 'm':
+				budget = atoi(optarg);
+			break;
+			case '0':
+				separator = '\0';
+			break;
+			case 'l':
+				list = optarg;
+			break;
+			case 'c':
+				compile = optarg;
+			break;
+			case 't':
+				threshold = atof(optarg);
+			break;
+			case 'b':
+				// area as 1/area of the image, squareness, XY ratio, WH ratio; as the tuner prints them.
+				if (sscanf(optarg, "%lf,%lf,%lf,%lf", &bounds._minArea, &bounds._minSquareness, &bounds._minXYratio, &bounds._minWHratio) != 4 || bounds._minArea <= 0)
+				{
+					cerr << "ERROR: invalid bounds " << optarg << ", expected area,squareness,XYratio,WHratio" << endl;
+					return 1;
+				}
+				bounds._minArea = 1. / bounds._minArea;
+				setBounds = true;
+			break;
 		}	
 	}
 
+	// A bundle is compiled from the histograms, not from the detector.model that may have been loaded.
+	if (compile)
+		sf.useHistograms();
+	if (threshold >= 0)
+		sf.setThreshold(threshold);
+	if (setBounds)
+		sf.setBlobBounds(bounds);
+
+	// Compile the detector model bundle, and stop.
+	if (compile)
+	{
+		sf.setShowPerformance(false);
+		if (!sf.saveModel(compile))
+		{
+			cerr << "ERROR: Could not write " << compile << endl;
+			return 1;
+		}
+		cout << "Wrote detector model " << compile << endl;
+		return 0;
+	}
+
 	// Create window if desired 
 	if (window)
 	{
@@ -98,15 +242,23 @@ int main(int argc, char** argv)
         	cvResizeWindow("signFinder", WINDOWX, WINDOWY);
 	}	
 
-        // iterate through all files.
-        _curFile = optind-1;
-        while (++_curFile < argc)
+        // iterate through all files, loading them depth files ahead within a budget of megabytes.
 	{
-		processFile(argv[_curFile]);
-		cvWaitKey(20);
+		FileSource files(argv + optind, argc - optind, separator);
+		if (list && !files.setList(list))
+		{
+			cerr << "ERROR: Could not open list " << list << endl;
+			exit(1);
+		}
+		Prefetcher prefetch(files, depth, (size_t) budget << 20, MIN(depth, MAX(threads, 1)));
+		prefetch.setImageSize(sf.getRes());
+		prefetch.setMasks(cvSize(0,0), CV_LOAD_IMAGE_COLOR, false);
+		prefetch.setTexts();
+		BatchQueue queue(threads, prefetch);
+		queue.run();
 	}
 
-	cvWaitKey(1000);
+	if (window)
+		cvWaitKey(1000);
         return 0;
 }
-
@@ -37,6 +37,7 @@
 #include <stdio.h>
 #include <iostream>
 #include <math.h>
+#include <limits.h>
 #include "CornerFinder.h"
 #include "TestHandler.h"
 
@@ -44,30 +45,72 @@ const bool _debug = false;
 
 using namespace std;
 
-/* Finds the corners in a binary mask, and writes them to the 'corner' CvPoint array. */
-int findCorners(IplImage* maskImg, CvPoint* corners, int numCorners, double distThr)
+/** CornerScratch constructor */
+CornerScratch::CornerScratch()
+{
+	_fill = _eig = _tmp = NULL;
+	_storage = cvCreateMemStorage();
+}
+
+/** CornerScratch destructor */
+CornerScratch::~CornerScratch()
+{
+	if (_fill)
+		cvReleaseImage(&_fill);
+	if (_eig)
+		cvReleaseImage(&_eig);
+	if (_tmp)
+		cvReleaseImage(&_tmp);
+	cvReleaseMemStorage(&_storage);
+}
+
+/**
+ * Make the buffers at least size big, and set their region of interest to (0,0) - size.
+ */
+void CornerScratch::prepare(CvSize size)
+{
+	if (!_fill || _fill->width < size.width || _fill->height < size.height)
+	{
+		CvSize capacity = size;
+		if (_fill)
+		{
+			capacity.width = MAX(capacity.width, _fill->width);
+			capacity.height = MAX(capacity.height, _fill->height);
+			cvReleaseImage(&_fill);
+			cvReleaseImage(&_eig);
+			cvReleaseImage(&_tmp);
+		}
+		_fill = cvCreateImage(capacity,IPL_DEPTH_8U,1);
+		_eig = cvCreateImage(capacity,IPL_DEPTH_32F,1);
+		_tmp = cvCreateImage(capacity,IPL_DEPTH_32F,1);
+	}
+	CvRect roi = cvRect(0, 0, size.width, size.height);
+	cvSetImageROI(_fill, roi);
+	cvSetImageROI(_eig, roi);
+	cvSetImageROI(_tmp, roi);
+	cvClearMemStorage(_storage);
+}
+
+/*
+ * Finds the corners in a binary mask that starts at offset in the frame, and writes them, in frame
+ * coordinates, to the 'corner' CvPoint array. eigtmp and tmp2 are 32F images of the size of the mask.
+ */
+static int findCorners(IplImage* maskImg, IplImage* eigtmp, IplImage* tmp2, CvMemStorage* storage, CvPoint offset, CvPoint* corners, int numCorners, double distThr)
 {
 	CvPoint2D32f f_corners[numCorners];
 	memset(corners,0,sizeof(CvPoint) * numCorners);
 
 	// Extract the corners.
-	IplImage* eigtmp = cvCreateImage(cvSize(maskImg->width, maskImg->height),IPL_DEPTH_32F,1);
-	IplImage* tmp2 = cvCreateImage(cvSize(maskImg->width, maskImg->height),IPL_DEPTH_32F,1);
 	int cornersFound = numCorners;
 	cvGoodFeaturesToTrack(maskImg,eigtmp,tmp2,f_corners,&cornersFound, 0.1,distThr,NULL,9);
 	if (_debug) cerr << "findCorners:: Found " << cornersFound << " Corners." << endl;
 
-	//Cleanup
-	cvReleaseImage(&tmp2);
-	cvReleaseImage(&eigtmp);
-
-	// Convert the detected corners to CvPoints.
+	// Convert the detected corners to CvPoints in the frame.
 	CvPoint foundcorners[numCorners];
 	for (int i=0; i<numCorners; ++i)
-		foundcorners[i] = cvPointFrom32f(f_corners[i]);
+		foundcorners[i] = cvPointFrom32f(cvPoint2D32f(f_corners[i].x + offset.x, f_corners[i].y + offset.y));
 
 	// create a convex hull of the points.
-	CvMemStorage* storage = cvCreateMemStorage();
         CvSeq* ptseq = cvCreateSeq( CV_SEQ_KIND_GENERIC|CV_32SC2, sizeof(CvContour), sizeof(CvPoint), storage );
         for(int i = 0; i < numCorners; i++ )
 		cvSeqPush(ptseq,&(foundcorners[i]));
@@ -99,16 +142,150 @@ int findCorners(IplImage* maskImg, CvPoint* corners, int numCorners, double dist
 	return cornersFound;
 }
 
-/* Find the corners of the convex hull around the blob with the cvGoodFeaturesToTrack function*/
-int findCorners(CBlob& blob, CvPoint* corners, int numCorners, double distThr)
+/* Finds the corners in a binary mask, and writes them to the 'corner' CvPoint array. */
+int findCorners(IplImage* maskImg, CvPoint* corners, int numCorners, double distThr)
+{
+	IplImage* eigtmp = cvCreateImage(cvSize(maskImg->width, maskImg->height),IPL_DEPTH_32F,1);
+	IplImage* tmp2 = cvCreateImage(cvSize(maskImg->width, maskImg->height),IPL_DEPTH_32F,1);
+	CvMemStorage* storage = cvCreateMemStorage();
+
+	int cornersFound = findCorners(maskImg, eigtmp, tmp2, storage, cvPoint(0,0), corners, numCorners, distThr);
+
+	//Cleanup
+	cvReleaseMemStorage(&storage);
+	cvReleaseImage(&tmp2);
+	cvReleaseImage(&eigtmp);
+	return cornersFound;
+}
+
+/*
+ * Find the corners of the convex hull around the blob with the cvGoodFeaturesToTrack function.
+ * Only the bounding box of the hull, with a margin of 10 pixels, is filled and searched, in the
+ * buffers of scratch if given. The margin keeps the corner response at the hull the same as on a full frame.
+ */
+int findCorners(CBlob& blob, CvPoint* corners, int numCorners, double distThr, CornerScratch* scratch)
+{
+	const int margin = 10;
+	CornerScratch local;
+	if (!scratch)
+		scratch = &local;
+
+	// Bounding box of the convex hull around the blob.
+	CvSeq* hull;
+        blob.GetConvexHull(&hull);
+	if (!hull || hull->total == 0)
+	{
+		memset(corners,0,sizeof(CvPoint) * numCorners);
+		return 0;
+	}
+	CvPoint points[hull->total];
+	int minx = INT_MAX, miny = INT_MAX, maxx = INT_MIN, maxy = INT_MIN;
+	for (int j=0; j< hull->total; ++j)
+	{
+		points[j] = **CV_GET_SEQ_ELEM( CvPoint*, hull, j );
+		minx = MIN(minx, points[j].x); maxx = MAX(maxx, points[j].x);
+		miny = MIN(miny, points[j].y); maxy = MAX(maxy, points[j].y);
+	}
+
+	// The region: from the margin before the hull (or the frame's edge), up to the margin after the blob.
+	CvPoint offset = cvPoint(MAX(minx - margin, 0), MAX(miny - margin, 0));
+	CvSize size = cvSize(MAX((int) blob.MaxX(), maxx + 1) + margin - offset.x, MAX((int) blob.MaxY(), maxy + 1) + margin - offset.y);
+	scratch->prepare(size);
+
+	// Fill the convex hull around the blob, in region coordinates.
+	for (int j=0; j< hull->total; ++j)
+		points[j] = cvPoint(points[j].x - offset.x, points[j].y - offset.y);
+	cvSet(scratch->_fill,cvScalar(0,0,0,0));
+	cvFillConvexPoly(scratch->_fill,points,hull->total,cvScalar(255,0,0,0));
+
+	return findCorners(scratch->_fill, scratch->_eig, scratch->_tmp, scratch->_storage, offset, corners, numCorners, distThr);
+}
+
+/* Twice the signed area of triangle (a, b, c); positive when a, b, c turn counter-clockwise, with the y-axis up. */
+static inline double triangleArea2(const CvPoint& a, const CvPoint& b, const CvPoint& c)
 {
-	// Fill the convex hull around the blob.
-	IplImage* fill = cvCreateImage(cvSize(blob.MaxX()+10, blob.MaxY()+10),IPL_DEPTH_8U,1);
-	fillConvexHull(fill,&blob,cvScalar(255,0,0,0));	
+	return (double) (b.x - a.x) * (c.y - a.y) - (double) (c.x - a.x) * (b.y - a.y);
+}
 
-	int foundcorners = findCorners(fill, corners, numCorners, distThr);
-	cvReleaseImage(&fill);
-	return foundcorners;
+/*
+ * Fits a polygon of numCorners corners to the convex hull around the blob, and writes its corners
+ * to the 'corner' CvPoint array, in the order of findCorners: counter-clockwise, upper-left point first.
+ * Works on the points of the hull only, without images: the hull point that spans the smallest triangle
+ * with its two neighbours adds the least to the shape, and is dropped, until numCorners points are left.
+ * On a street sign, these are the points closest to its corners, also when the corners are cut off or rounded.
+ * Returns the number of corners found, which is less than numCorners when the hull has fewer points.
+ */
+int fitQuadrilateral(CBlob& blob, CvPoint* corners, int numCorners)
+{
+	memset(corners,0,sizeof(CvPoint) * numCorners);
+
+	CvSeq* hull;
+	blob.GetConvexHull(&hull);
+	if (!hull || hull->total < numCorners)
+		return 0;
+
+	// Copy the hull into an array, counter-clockwise.
+	int n = hull->total;
+	CvPoint points[n];
+	for (int j=0; j< n; ++j)
+		points[j] = **CV_GET_SEQ_ELEM( CvPoint*, hull, j );
+	double area = 0;
+	for (int j=0; j< n; ++j)
+		area += triangleArea2(cvPoint(0,0), points[j], points[(j+1) % n]);
+	if (area < 0)
+		for (int j=0; j< n/2; ++j)
+		{
+			CvPoint tmp = points[j];
+			points[j] = points[n-1-j];
+			points[n-1-j] = tmp;
+		}
+
+	// Drop points from a ring of the remaining ones, smallest triangle first.
+	int prev[n], next[n];
+	double cost[n];
+	for (int j=0; j< n; ++j)
+	{
+		prev[j] = (j+n-1) % n;
+		next[j] = (j+1) % n;
+	}
+	for (int j=0; j< n; ++j)
+		cost[j] = fabs(triangleArea2(points[prev[j]], points[j], points[next[j]]));
+	int first = 0;
+	for (int left = n; left > numCorners; --left)
+	{
+		int mini = first;
+		for (int j = next[first]; j != first; j = next[j])
+			if (cost[j] < cost[mini])
+				mini = j;
+
+		// Unlink the point, and update the triangles of its neighbours.
+		int p = prev[mini], q = next[mini];
+		next[p] = q;
+		prev[q] = p;
+		if (mini == first)
+			first = q;
+		cost[p] = fabs(triangleArea2(points[prev[p]], points[p], points[q]));
+		cost[q] = fabs(triangleArea2(points[p], points[q], points[next[q]]));
+	}
+
+	// Find the upper left point.
+	double mindist = 1000000000;
+	int mindisti = first;
+	CvPoint upperLeft = cvPoint(0,0);
+	int j = first;
+	for (int i=0; i<numCorners; ++i, j = next[j])
+		if (pointDist(upperLeft, points[j]) < mindist)
+		{
+			mindist = pointDist(upperLeft, points[j]);
+			mindisti = j;
+		}
+
+	// Push results to the result-array with the upper-left point on index 0.
+	j = mindisti;
+	for (int i=0; i<numCorners; ++i, j = next[j])
+		corners[i] = points[j];
+	if (_debug) cerr << "fitQuadrilateral:: Reduced " << n << " hull points to " << numCorners << " corners." << endl;
+	return numCorners;
 }
 
 /* Find corners by finding the points exceeding the angle-threshold in the convex hull*/
@@ -1,11 +1,40 @@
+#ifndef CORNERFINDER_H
+#define CORNERFINDER_H
+
 #include <opencv/cv.h>
 #include "lib/bloblib/Blob.h"
 #include "lib/bloblib/BlobResult.h"
 
-int findCorners(CBlob& blob, CvPoint* corners, int numCorners = 4, double distThr = 10);
+/**
+ * Scratch buffers of findCorners(CBlob&, ...), reused between calls. They grow to the largest
+ * region seen so far, and every call works on a region of interest of them.
+ * Not thread-safe: use one per thread, see SignFinder::Context.
+ */
+class CornerScratch
+{
+	public:
+		CornerScratch();
+		~CornerScratch();
+
+		void prepare(CvSize size);
+
+		IplImage* _fill;
+		IplImage* _eig;
+		IplImage* _tmp;
+		CvMemStorage* _storage;
+
+	private:
+		CornerScratch(const CornerScratch&);
+		CornerScratch& operator=(const CornerScratch&);
+};
+
+int findCorners(CBlob& blob, CvPoint* corners, int numCorners = 4, double distThr = 10, CornerScratch* scratch = NULL);
 int findCorners(IplImage* maskImage, CvPoint* corners, int numCorners = 4, double distThr = 10);
+int fitQuadrilateral(CBlob& blob, CvPoint* corners, int numCorners = 4);
 
 /* Support */
 CvPoint findClosestConvexHullPoint(CvPoint corner, CvSeq* hull);
 double pointDist(CvPoint& p0, CvPoint& p1);
 double pointDist(CvPoint2D32f& p0, CvPoint2D32f& p1);
+
+#endif
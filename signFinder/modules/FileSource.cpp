@@ -0,0 +1,136 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FileSource.cpp .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+/*
+ * The stream of input files of the command line tools. Files are taken from
+ * the command line, where '-' stands for a list of paths on stdin, and from
+ * a list file given with --list. Lists are read while the files are being
+ * processed, so a batch of any size runs in one process, without running
+ * into the maximum length of a command line.
+ * Paths in a list are separated by newlines, or by NUL characters (-0), as
+ * written by find -print0.
+ */
+
+#include <string.h>
+#include "FileSource.h"
+
+/**
+ * @param files, count : the file arguments of the command line. '-' reads a list from stdin.
+ * @param separator : the character between the paths in a list.
+ */
+FileSource::FileSource(char** files, int count, char separator)
+{
+	_files = files;
+	_count = count;
+	_index = 0;
+	_separator = separator;
+	_list = NULL;
+	_stdin = false;
+}
+
+FileSource::~FileSource()
+{
+	if (_list && _list != stdin)
+		fclose(_list);
+}
+
+/**
+ * Read the paths in list before the files of the command line. '-' is stdin.
+ * @return false if the list can't be opened.
+ */
+bool FileSource::setList(const char* list)
+{
+	if (_list && _list != stdin)
+		fclose(_list);
+	_list = strcmp(list, "-") ? fopen(list, "r") : stdin;
+	return _list != NULL;
+}
+
+/**
+ * Gives the next file.
+ * @return false after the last one.
+ */
+bool FileSource::next(string& file)
+{
+	if (_list)
+	{
+		if (readPath(_list, file))
+			return true;
+		if (_list != stdin)
+			fclose(_list);
+		_list = NULL;
+	}
+
+	while (true)
+	{
+		if (_stdin)
+		{
+			if (readPath(stdin, file))
+				return true;
+			_stdin = false;
+		}
+		if (_index >= _count)
+			return false;
+
+		char* arg = _files[_index++];
+		if (strcmp(arg, "-"))
+		{
+			file = arg;
+			return true;
+		}
+		_stdin = true;
+	}
+}
+
+/**
+ * Reads the next path of a list. Empty entries are skipped, and so is the carriage return
+ * of a newline-separated list with DOS line ends.
+ * @return false at the end of the list.
+ */
+bool FileSource::readPath(FILE* f, string& file)
+{
+	int c = 0;
+	while (c != EOF)
+	{
+		file.clear();
+		while ((c = getc(f)) != EOF && c != _separator)
+			file += (char) c;
+		if (_separator == '\n' && !file.empty() && file[file.size() - 1] == '\r')
+			file.erase(file.size() - 1);
+		if (!file.empty())
+			return true;
+	}
+	return false;
+}
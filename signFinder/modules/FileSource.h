@@ -0,0 +1,36 @@
+/* 
+ * See .cpp file for more information
+ */
+
+#ifndef FILESOURCE_H
+#define FILESOURCE_H
+
+#include <stdio.h>
+#include <string>
+
+using namespace std;
+
+class FileSource
+{
+	public:
+		FileSource(char** files, int count, char separator = '\n');
+		virtual ~FileSource();
+
+		bool setList(const char* list);
+		virtual bool next(string& file);
+
+	protected:
+		bool readPath(FILE* f, string& file);
+
+	private:
+		char** _files;
+		int _count, _index;
+		char _separator;
+		FILE* _list;
+		bool _stdin;
+
+		FileSource(const FileSource&);
+		FileSource& operator=(const FileSource&);
+};
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FrameContext.cpp .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+
+/*
+ * The planes derived from the current frame: the floating point integral image
+ * that SURF works on, and the grey planes it's built from. Each is built on
+ * first use and kept until the next frame. The buffers are kept between frames.
+ */
+
+#include "FrameContext.h"
+#include "OpenSURF/integral.h"
+
+/** Constructor */
+FrameContext::FrameContext()
+{
+	_frame = NULL;
+	_valid = 0;
+	_grey = _grey32 = _integral = NULL;
+}
+
+/** Destructor */
+FrameContext::~FrameContext()
+{
+	IplImage** planes[] = {&_grey, &_grey32, &_integral};
+	for (unsigned int i = 0; i < sizeof(planes) / sizeof(planes[0]); ++i)
+		if (*planes[i])
+			cvReleaseImage(planes[i]);
+}
+
+/**
+ * Start on a new frame, 8 bit BGR. The frame is borrowed and must stay valid
+ * while planes are requested; all planes of the previous frame are dropped.
+ */
+void FrameContext::setFrame(IplImage* bgr)
+{
+	_frame = bgr;
+	_valid = 0;
+}
+
+/**
+ * Reuse the image in slot if it has the requested format, replace it otherwise.
+ */
+IplImage* FrameContext::plane(IplImage*& slot, CvSize size, int depth, int channels)
+{
+	if (slot && (slot->width != size.width || slot->height != size.height || slot->depth != depth || slot->nChannels != channels))
+		cvReleaseImage(&slot);
+	if (!slot)
+		slot = cvCreateImage(size, depth, channels);
+	return slot;
+}
+
+/** @return 8 bit grey version of the frame. */
+IplImage* FrameContext::grey()
+{
+	if (!(_valid & GREY))
+	{
+		plane(_grey, cvGetSize(_frame), IPL_DEPTH_8U, 1);
+		if (_frame->nChannels == 1)
+			cvCopy(_frame, _grey);
+		else
+			cvCvtColor(_frame, _grey, CV_BGR2GRAY);
+		_valid |= GREY;
+	}
+	return _grey;
+}
+
+/** @return grey version of the frame as 32 bit floats in 0..1, as getGray in OpenSURF. */
+IplImage* FrameContext::grey32()
+{
+	if (!(_valid & GREY32))
+	{
+		plane(_grey32, cvGetSize(_frame), IPL_DEPTH_32F, 1);
+		cvConvertScale(grey(), _grey32, 1.0 / 255.0, 0);
+		_valid |= GREY32;
+	}
+	return _grey32;
+}
+
+/** @return integral image of grey32, in the layout of OpenSURF's Integral. */
+IplImage* FrameContext::integral()
+{
+	if (!(_valid & INTEGRAL))
+	{
+		plane(_integral, cvGetSize(_frame), IPL_DEPTH_32F, 1);
+		IntegralInto(grey32(), _integral);
+		_valid |= INTEGRAL;
+	}
+	return _integral;
+}
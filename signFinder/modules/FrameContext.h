@@ -0,0 +1,44 @@
+/* 
+ * See .cpp file for more information
+ */
+
+#ifndef FRAMECONTEXT_H
+#define FRAMECONTEXT_H
+
+#include <opencv/cv.h>
+
+class FrameContext
+{
+	public:
+		FrameContext();
+		~FrameContext();
+
+		void setFrame(IplImage* bgr);
+		IplImage* frame() const {return _frame;}
+
+		IplImage* integral();
+
+	private:
+		enum Plane
+		{
+			GREY = 1,
+			GREY32 = 2,
+			INTEGRAL = 4
+		};
+
+		IplImage* plane(IplImage*& slot, CvSize size, int depth, int channels);
+		IplImage* grey();
+		IplImage* grey32();
+
+		IplImage* _frame;
+		int _valid;
+
+		IplImage* _grey;
+		IplImage* _grey32;
+		IplImage* _integral;
+
+		FrameContext(const FrameContext&);
+		FrameContext& operator=(const FrameContext&);
+};
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is ImageLoader.cpp .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+/*
+ * Image loading at the resolution it will be used at. Camera JPEGs are often
+ * several times larger than the frame the detection works on; libjpeg can
+ * scale them down by 1/2, 1/4 or 1/8 in its inverse DCT, which skips most of
+ * the decoding work. The image is decoded at the smallest of these scales that
+ * is still at least as large as the target, and then resampled as before.
+ * Other formats, and builds without libjpeg, go through cvLoadImage.
+ * Encoded images in memory are decoded the same way; other formats than JPEG
+ * pass through a temporary file, since cvLoadImage only reads from files.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <opencv/highgui.h>
+#include "ImageLoader.h"
+
+using namespace std;
+
+#ifdef HAVE_LIBJPEG
+#include <setjmp.h>
+extern "C" {
+#include <jpeglib.h>
+#include <jerror.h>
+}
+
+/* libjpeg error handler that returns to decodeJpeg instead of exiting. */
+struct JpegError
+{
+	struct jpeg_error_mgr mgr;
+	jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr cinfo)
+{
+	longjmp(((JpegError*) cinfo->err)->jump, 1);
+}
+
+/* libjpeg source manager that reads from memory. libjpeg 6b doesn't have jpeg_mem_src. */
+static void memInitSource(j_decompress_ptr) {}
+static void memTermSource(j_decompress_ptr) {}
+
+static boolean memFillInputBuffer(j_decompress_ptr cinfo)
+{
+	// The data is all there: past its end, insert an end-of-image marker, as jdatasrc.c does.
+	static const JOCTET eoi[2] = {0xFF, JPEG_EOI};
+	WARNMS(cinfo, JWRN_JPEG_EOF);
+	cinfo->src->next_input_byte = eoi;
+	cinfo->src->bytes_in_buffer = 2;
+	return TRUE;
+}
+
+static void memSkipInputData(j_decompress_ptr cinfo, long numBytes)
+{
+	if (numBytes <= 0)
+		return;
+	if ((size_t) numBytes > cinfo->src->bytes_in_buffer)
+		memFillInputBuffer(cinfo);
+	else
+	{
+		cinfo->src->next_input_byte += numBytes;
+		cinfo->src->bytes_in_buffer -= numBytes;
+	}
+}
+
+/**
+ * Decodes a JPEG file, or if fp is NULL size bytes of data, at the smallest scale of 1/1, 1/2, 1/4 and 1/8
+ * that is at least target. A target without a positive width and height decodes at full size.
+ * @param fullSize if not NULL, receives the size of the image before the reduction.
+ * @return the image, or NULL if it is not a JPEG libjpeg can convert to the requested colors.
+ */
+static IplImage* decodeJpeg(FILE* fp, const unsigned char* data, size_t size, CvSize target, bool color, CvSize* fullSize)
+{
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_source_mgr memSource;
+	JpegError err;
+	IplImage* volatile img = NULL;
+
+	cinfo.err = jpeg_std_error(&err.mgr);
+	err.mgr.error_exit = jpegErrorExit;
+	if (setjmp(err.jump))
+	{
+		jpeg_destroy_decompress(&cinfo);
+		if (img)
+			cvReleaseImage((IplImage**) &img);
+		return NULL;
+	}
+
+	jpeg_create_decompress(&cinfo);
+	if (fp)
+		jpeg_stdio_src(&cinfo, fp);
+	else
+	{
+		memSource.init_source = memInitSource;
+		memSource.fill_input_buffer = memFillInputBuffer;
+		memSource.skip_input_data = memSkipInputData;
+		memSource.resync_to_restart = jpeg_resync_to_restart;
+		memSource.term_source = memTermSource;
+		memSource.next_input_byte = data;
+		memSource.bytes_in_buffer = size;
+		cinfo.src = &memSource;
+	}
+	jpeg_read_header(&cinfo, TRUE);
+	if (cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK)
+	{
+		jpeg_destroy_decompress(&cinfo);
+		return NULL;
+	}
+
+	if (fullSize)
+		*fullSize = cvSize(cinfo.image_width, cinfo.image_height);
+
+	// Largest reduction that keeps the image at least as large as the target.
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = 1;
+	for (unsigned int denom = 8; target.width > 0 && target.height > 0 && denom > 1; denom /= 2)
+		if ((int) ((cinfo.image_width + denom - 1) / denom) >= target.width &&
+		    (int) ((cinfo.image_height + denom - 1) / denom) >= target.height)
+		{
+			cinfo.scale_denom = denom;
+			break;
+		}
+	cinfo.out_color_space = color ? JCS_RGB : JCS_GRAYSCALE;
+	jpeg_start_decompress(&cinfo);
+
+	img = cvCreateImage(cvSize(cinfo.output_width, cinfo.output_height), IPL_DEPTH_8U, color ? 3 : 1);
+	while (cinfo.output_scanline < cinfo.output_height)
+	{
+		JSAMPROW row = (JSAMPROW) (img->imageData + cinfo.output_scanline * img->widthStep);
+		jpeg_read_scanlines(&cinfo, &row, 1);
+
+		// libjpeg delivers RGB, OpenCV works in BGR.
+		if (color)
+			for (unsigned int x = 0; x < cinfo.output_width; ++x)
+			{
+				JSAMPLE tmp = row[3*x];
+				row[3*x] = row[3*x+2];
+				row[3*x+2] = tmp;
+			}
+	}
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	return img;
+}
+#endif
+
+/**
+ * Loads an image, as cvLoadImage does, but decodes JPEG files at a reduced scale when that still
+ * gives at least target.width x target.height pixels. The result is not resampled to the target;
+ * it can be anything from the target up to the full size of the file.
+ * @param target the size the image will be resampled to, or 0x0 for the full size.
+ * @param iscolor CV_LOAD_IMAGE_COLOR or CV_LOAD_IMAGE_GRAYSCALE.
+ * @param fullSize if not NULL, receives the size of the image in the file, to map coordinates in the result back to it.
+ * @return the image, or NULL if it could not be loaded.
+ */
+IplImage* loadImage(const char* file, CvSize target, int iscolor, CvSize* fullSize)
+{
+#ifdef HAVE_LIBJPEG
+	if (target.width > 0 && target.height > 0 && iscolor != CV_LOAD_IMAGE_UNCHANGED)
+	{
+		FILE* fp = fopen(file, "rb");
+		if (!fp)
+			return NULL;
+		unsigned char magic[2] = {0, 0};
+		IplImage* img = NULL;
+		if (fread(magic, 1, 2, fp) == 2 && magic[0] == 0xFF && magic[1] == 0xD8)
+		{
+			rewind(fp);
+			img = decodeJpeg(fp, NULL, 0, target, iscolor != CV_LOAD_IMAGE_GRAYSCALE, fullSize);
+		}
+		fclose(fp);
+		if (img)
+			return img;
+	}
+#endif
+	IplImage* img = cvLoadImage(file, iscolor);
+	if (img && fullSize)
+		*fullSize = cvGetSize(img);
+	return img;
+}
+
+/**
+ * Loads an image at exactly the given size: loadImage, followed by cvResize if it didn't come out at that size.
+ * Images and their masks loaded through this function, at the same size, stay aligned.
+ * @param size the size of the result, or 0x0 for the full size of the file.
+ * @return the image, or NULL if it could not be loaded.
+ */
+IplImage* loadImageAt(const char* file, CvSize size, int iscolor, int interpolation)
+{
+	IplImage* img = loadImage(file, size, iscolor);
+	if (!img || size.width <= 0 || size.height <= 0 || (img->width == size.width && img->height == size.height))
+		return img;
+
+	IplImage* resized = cvCreateImage(size, img->depth, img->nChannels);
+	cvResize(img, resized, interpolation);
+	cvReleaseImage(&img);
+	return resized;
+}
+
+/**
+ * Decodes an encoded image (a JPEG, PNG or any other format cvLoadImage reads) of size bytes in memory,
+ * as loadImage would load it from a file.
+ * @param fullSize if not NULL, receives the size of the encoded image.
+ * @return the image, or NULL if it could not be decoded.
+ */
+IplImage* decodeImage(const unsigned char* data, size_t size, CvSize target, int iscolor, CvSize* fullSize)
+{
+#ifdef HAVE_LIBJPEG
+	if (size >= 2 && data[0] == 0xFF && data[1] == 0xD8 && iscolor != CV_LOAD_IMAGE_UNCHANGED)
+	{
+		IplImage* img = decodeJpeg(NULL, data, size, target, iscolor != CV_LOAD_IMAGE_GRAYSCALE, fullSize);
+		if (img)
+			return img;
+	}
+#endif
+
+	// Through a temporary file.
+	const char* tmpdir = getenv("TMPDIR");
+	string name = string(tmpdir ? tmpdir : "/tmp") + "/signFinderXXXXXX";
+	int fd = mkstemp(&name[0]);
+	if (fd < 0)
+		return NULL;
+	size_t written = 0;
+	while (written < size)
+	{
+		ssize_t n = write(fd, data + written, size - written);
+		if (n <= 0)
+			break;
+		written += n;
+	}
+	close(fd);
+	IplImage* img = (written == size) ? cvLoadImage(name.c_str(), iscolor) : NULL;
+	unlink(name.c_str());
+	if (img && fullSize)
+		*fullSize = cvGetSize(img);
+	return img;
+}
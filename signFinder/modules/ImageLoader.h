@@ -0,0 +1,15 @@
+/* 
+ * See .cpp file for more information
+ */
+
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+
+IplImage* loadImage(const char* file, CvSize target = cvSize(0,0), int iscolor = CV_LOAD_IMAGE_COLOR, CvSize* fullSize = NULL);
+IplImage* decodeImage(const unsigned char* data, size_t size, CvSize target = cvSize(0,0), int iscolor = CV_LOAD_IMAGE_COLOR, CvSize* fullSize = NULL);
+IplImage* loadImageAt(const char* file, CvSize size, int iscolor = CV_LOAD_IMAGE_COLOR, int interpolation = CV_INTER_LINEAR);
+
+#endif
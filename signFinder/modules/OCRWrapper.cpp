@@ -40,6 +40,10 @@
 #include <fstream>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
+#ifdef HAVE_TESSERACT
+#include <tesseract/baseapi.h>
+#endif
 
 const bool _debug = false;
 
@@ -148,7 +152,129 @@ void correctLidwoorden(string& in)
 		in.replace(0,secondCapPos,candidates[index]);		
 }
 
-string extractText(IplImage* sign, CvHistogram* _posHist, CvHistogram* _negHist)
+/**
+ * Runs the tesseract executable on a temporary file per sign. Slow (fork/exec, model load and
+ * disk round trips for every sign), but needs nothing at compile time.
+ */
+class CommandLineOCR : public OCREngine
+{
+	public:
+		CommandLineOCR(const char* config) : _config(config) {}
+		const char* name() const {return "tesseract command";}
+
+		string recognize(IplImage* grey)
+		{
+			// The file names are unique per call, so that concurrent calls from several threads,
+			// or several processes in the same directory, don't read each others results.
+			static int ocrCount = 0;
+			char base[64];
+			snprintf(base, sizeof(base), "OCR-%d-%d", (int) getpid(), __sync_fetch_and_add(&ocrCount, 1));
+			string signfile = string(base) + ".tif";
+			cvSaveImage(signfile.c_str(),grey);
+
+			// Crunch the image through tesseract, and gather the results.
+			string command = "tesseract " + signfile + " " + base + " nobatch " + _config;
+			if (!_debug)
+				command += " 2> /dev/null";
+			system(command.c_str());
+			string result;
+			ifstream ifs((string(base) + ".txt").c_str());
+			if (!ifs.bad())
+				getline(ifs, result);
+			else
+				cerr << "WARNING: Could not read OCR results. Is tesseract properly installed?" << endl;
+
+			// Cleanup
+			remove(signfile.c_str());
+			remove((string(base) + ".txt").c_str());
+			remove((string(base) + ".raw").c_str());
+			remove((string(base) + ".map").c_str());
+			return result;
+		}
+
+	private:
+		string _config;
+};
+
+#ifdef HAVE_TESSERACT
+/**
+ * Tesseract linked in-process: initialised once, and fed the sign straight from memory.
+ * The variables of the config file (e.g. the character whitelist) are applied at initialisation.
+ */
+class TesseractOCR : public OCREngine
+{
+	public:
+		TesseractOCR() {}
+		~TesseractOCR() {_api.End();}
+		const char* name() const {return "tesseract library";}
+
+		bool init(const char* config)
+		{
+			if (_api.Init(NULL, "eng"))
+				return false;
+
+			ifstream ifs(config);
+			string line;
+			while (getline(ifs, line))
+			{
+				line = trim(line);
+				if (line.empty() || line[0] == '#')
+					continue;
+				size_t split = line.find_first_of(" \t");
+				if (split == string::npos)
+					continue;
+				string name = line.substr(0, split);
+				string value = trim(line.substr(split));
+				if (!_api.SetVariable(name.c_str(), value.c_str()))
+					cerr << "WARNING: tesseract does not know variable " << name << " from " << config << endl;
+			}
+			return true;
+		}
+
+		string recognize(IplImage* grey)
+		{
+			_api.SetImage((const unsigned char*) grey->imageData, grey->width, grey->height, 1, grey->widthStep);
+			char* text = _api.GetUTF8Text();
+			string result = text ? text : "";
+			delete[] text;
+			_api.Clear();
+
+			// Same as reading the first line of the output file.
+			size_t eol = result.find('\n');
+			if (eol != string::npos)
+				result.erase(eol);
+			return result;
+		}
+
+	private:
+		tesseract::TessBaseAPI _api;
+};
+#endif
+
+/**
+ * Create an OCR engine. When built with tesseract (make TESSERACT=1), and inProcess is set,
+ * the library is used; otherwise, or when it fails to initialise, the tesseract executable.
+ * @param config : tesseract config file, e.g. with the character whitelist.
+ */
+OCREngine* OCREngine::create(const char* config, bool inProcess)
+{
+#ifdef HAVE_TESSERACT
+	if (inProcess)
+	{
+		TesseractOCR* engine = new TesseractOCR;
+		if (engine->init(config))
+			return engine;
+		cerr << "WARNING: Could not initialise the tesseract library, falling back to the tesseract executable." << endl;
+		delete engine;
+	}
+#endif
+	return new CommandLineOCR(config);
+}
+
+/**
+ * OCR a cut-out sign with the given engine, and correct the result with a few heuristics.
+ */
+string extractText(IplImage* sign, OCREngine* engine)
 {
 	// Convert image to greyscale.
      	IplImage* grey = cvCreateImage(cvGetSize(sign), IPL_DEPTH_8U, 1);
@@ -158,30 +284,9 @@ string extractText(IplImage* sign, CvHistogram* _posHist, CvHistogram* _negHist)
 	cvCopy(sign,grey);
 	cvSetImageCOI(sign,0);
 
-	// save the image for tesseract + cleanup
-	//cvSaveImage("OCRsign.tif",histMatched);
-	cvSaveImage("OCRsign.tif",grey);
+	string result = engine->recognize(grey);
 	cvReleaseImage(&grey);
 
-	// Crunch the image through tesseract, and gather the results.
-	if (_debug)
-		system("tesseract OCRsign.tif OCR nobatch modules/signOCR.conf");
-	else
-		system("tesseract OCRsign.tif OCR nobatch modules/signOCR.conf 2> /dev/null");
-	string result;
-	result[0] = 0;
-	ifstream ifs("OCR.txt");
-	if (!ifs.bad())
-		getline(ifs, result);
-	else
-		cerr << "WARNING: Could not read OCR results. Is tesseract properly installed?" << endl;
-	
-	// Cleanup
-	remove("OCRsign.tif");
-	remove("OCR.txt");
-	remove("OCR.raw");
-	remove("OCR.map");
-
 	if (_debug) cerr << "** before OCR heuristics:\t" << result << endl;	
 	removeOneCharWords(result);
 	detectWrongCapitalI(result);
@@ -189,3 +294,14 @@ string extractText(IplImage* sign, CvHistogram* _posHist, CvHistogram* _negHist)
 	if (_debug) cerr << "** after OCR heuristics:\t" << result << endl;	
 	return result;
 }
+
+/**
+ * OCR a cut-out sign with a temporary engine. Convenient, but pays the engine initialisation for every sign.
+ */
+string extractText(IplImage* sign, CvHistogram* _posHist, CvHistogram* _negHist)
+{
+	OCREngine* engine = OCREngine::create();
+	string result = extractText(sign, engine);
+	delete engine;
+	return result;
+}
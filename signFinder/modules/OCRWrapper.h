@@ -2,4 +2,19 @@
 #include<opencv/cv.h>
 using namespace std;
 
+/**
+ * An OCR backend. Engines keep their state between calls, so create one per thread and reuse it.
+ */
+class OCREngine
+{
+	public:
+		virtual ~OCREngine() {}
+		/** @return the first line of text in an 8 bit greyscale image. */
+		virtual string recognize(IplImage* grey) = 0;
+		virtual const char* name() const = 0;
+
+		static OCREngine* create(const char* config = "modules/signOCR.conf", bool inProcess = true);
+};
+
+string extractText(IplImage* sign, OCREngine* engine);
 string extractText(IplImage* sign, CvHistogram* _posHist, CvHistogram* _negHist);
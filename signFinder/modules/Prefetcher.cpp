@@ -0,0 +1,262 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is Prefetcher.cpp .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+/*
+ * Loads the input files of the command line tools ahead of the workers that
+ * process them: the image, and its <file>_mask.png and <file>.txt labels if
+ * asked for. Loader threads keep up to 'depth' files loaded in advance, so
+ * reading and decoding the next files overlaps with the processing of the
+ * current ones, which matters on slow (network) file systems.
+ * Memory is bounded by the depth, and by a budget on the bytes of the items
+ * that are loaded but not yet released. A loader only starts on a new file
+ * while the items in memory stay below the budget, so it can be exceeded by
+ * at most the files that are being loaded at that moment, one per thread.
+ * Items come out of next() in the order of the files. The files are taken
+ * from the source only when there's room to load them, so a list of any
+ * length is streamed.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <opencv/highgui.h>
+#include "Prefetcher.h"
+#include "ImageLoader.h"
+
+/**
+ * @param files : the files to load, in order.
+ * @param depth : number of files to load ahead. With 0, nothing is loaded ahead: next() returns the files
+ *                unloaded, and the workers load them with fetch, in parallel.
+ * @param budget : maximum number of bytes of loaded, unreleased items, or 0 for no limit.
+ * @param threads : number of loader threads.
+ */
+Prefetcher::Prefetcher(FileSource& files, int depth, size_t budget, int threads) : _files(files)
+{
+	_depth = (depth > 0) ? depth : 0;
+	_budget = budget;
+	_threads = (threads < 1) ? 1 : threads;
+	_imageSize = _maskSize = cvSize(0,0);
+	_exact = _masks = _maskRequired = _texts = false;
+	_maskColor = CV_LOAD_IMAGE_COLOR;
+	_started = _stopping = _exhausted = false;
+	_dispatched = _taken = 0;
+	_bytes = 0;
+	pthread_mutex_init(&_lock, NULL);
+	pthread_cond_init(&_readyCond, NULL);
+	pthread_cond_init(&_spaceCond, NULL);
+}
+
+/** Stops the loaders, and releases the items that were loaded but not taken. */
+Prefetcher::~Prefetcher()
+{
+	pthread_mutex_lock(&_lock);
+	_stopping = true;
+	pthread_cond_broadcast(&_spaceCond);
+	pthread_mutex_unlock(&_lock);
+	for (unsigned int i = 0; i < _loaders.size(); ++i)
+		pthread_join(_loaders[i], NULL);
+
+	for (map<long, Item*>::iterator it = _ready.begin(); it != _ready.end(); ++it)
+		release(it->second);
+	pthread_cond_destroy(&_spaceCond);
+	pthread_cond_destroy(&_readyCond);
+	pthread_mutex_destroy(&_lock);
+}
+
+/**
+ * Load the images for a frame of the given size: decoded at no more than that size (see loadImage),
+ * or, when exact, resized to it. 0x0 loads them at full size.
+ */
+void Prefetcher::setImageSize(CvSize size, bool exact)
+{
+	_imageSize = size;
+	_exact = exact;
+}
+
+/**
+ * Load the <file>_mask.png masks as well, with loadImageAt at the given size (0x0 for their own size).
+ * @param required : don't load the image of a file that has no mask.
+ */
+void Prefetcher::setMasks(CvSize size, int iscolor, bool required)
+{
+	_masks = true;
+	_maskSize = size;
+	_maskColor = iscolor;
+	_maskRequired = required;
+}
+
+/**
+ * Returns the next file, blocking until it's loaded, or NULL after the last one. With a depth of 0,
+ * the file is not loaded yet; call fetch on it before use, so the loading happens on the caller's worker.
+ * Items have to be released as soon as they are processed: they count against the budget until then.
+ */
+Prefetcher::Item* Prefetcher::next()
+{
+	if (!_depth)
+	{
+		string file;
+		return _files.next(file) ? load(file, false) : NULL;
+	}
+
+	pthread_mutex_lock(&_lock);
+	if (!_started)
+	{
+		_started = true;
+		_loaders.resize(_threads);
+		for (int i = 0; i < _threads; ++i)
+			pthread_create(&_loaders[i], NULL, loaderMain, this);
+	}
+
+	Item* item = NULL;
+	while (!_ready.count(_taken) && !(_exhausted && _taken == _dispatched))
+		pthread_cond_wait(&_readyCond, &_lock);
+	if (_ready.count(_taken))
+	{
+		item = _ready[_taken];
+		_ready.erase(_taken++);
+		pthread_cond_broadcast(&_spaceCond);
+	}
+	pthread_mutex_unlock(&_lock);
+	return item;
+}
+
+/**
+ * Loads an item that next() returned unloaded, on the calling thread. Does nothing for an item that is loaded.
+ */
+void Prefetcher::fetch(Item* item)
+{
+	if (item->loaded)
+		return;
+	Item* loaded = load(item->file);
+	*item = *loaded;
+	delete loaded;
+
+	pthread_mutex_lock(&_lock);
+	_bytes += item->bytes;
+	pthread_mutex_unlock(&_lock);
+}
+
+/** Frees an item that was returned by next(). */
+void Prefetcher::release(Item* item)
+{
+	if (item->image)
+		cvReleaseImage(&item->image);
+	if (item->labels.mask)
+		cvReleaseImage(&item->labels.mask);
+
+	pthread_mutex_lock(&_lock);
+	_bytes -= item->bytes;
+	pthread_cond_broadcast(&_spaceCond);
+	pthread_mutex_unlock(&_lock);
+	delete item;
+}
+
+void* Prefetcher::loaderMain(void* arg)
+{
+	((Prefetcher*) arg)->loader();
+	return NULL;
+}
+
+/**
+ * Loader loop: while there's room ahead of the consumer and in the budget, load the next file.
+ */
+void Prefetcher::loader()
+{
+	pthread_mutex_lock(&_lock);
+	while (true)
+	{
+		while (!_stopping && !_exhausted &&
+			(_dispatched - _taken >= _depth || (_budget && _bytes >= _budget)))
+			pthread_cond_wait(&_spaceCond, &_lock);
+		if (_stopping || _exhausted)
+			break;
+
+		string file;
+		if (!_files.next(file))
+		{
+			_exhausted = true;
+			pthread_cond_broadcast(&_readyCond);
+			pthread_cond_broadcast(&_spaceCond);
+			break;
+		}
+		long seq = _dispatched++;
+		pthread_mutex_unlock(&_lock);
+
+		Item* item = load(file);
+
+		pthread_mutex_lock(&_lock);
+		_bytes += item->bytes;
+		_ready[seq] = item;
+		pthread_cond_broadcast(&_readyCond);
+	}
+	pthread_mutex_unlock(&_lock);
+}
+
+/**
+ * Loads a file and its labels.
+ * @param now : false only creates the item, for fetch to load.
+ */
+Prefetcher::Item* Prefetcher::load(const string& file, bool now) const
+{
+	Item* item = new Item;
+	item->file = file;
+	item->image = NULL;
+	item->bytes = 0;
+	item->loaded = now;
+	if (!now)
+		return item;
+
+	if (_masks)
+	{
+		item->labels.mask = loadImageAt((file + "_mask.png").c_str(), _maskSize, _maskColor);
+		if (item->labels.mask)
+			item->bytes += item->labels.mask->imageSize;
+	}
+	if (!_maskRequired || item->labels.mask)
+	{
+		item->image = _exact ? loadImageAt(file.c_str(), _imageSize) : loadImage(file.c_str(), _imageSize);
+		if (item->image)
+			item->bytes += item->image->imageSize;
+	}
+	if (_texts)
+	{
+		ifstream ifs((file + ".txt").c_str());
+		ostringstream text;
+		if (ifs)
+			text << ifs.rdbuf();
+		item->labels.text = text.str();
+		item->bytes += item->labels.text.size();
+	}
+	return item;
+}
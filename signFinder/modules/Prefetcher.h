@@ -0,0 +1,67 @@
+/* 
+ * See .cpp file for more information
+ */
+
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <pthread.h>
+#include <map>
+#include <vector>
+#include <opencv/cv.h>
+#include "TestHandler.h"
+#include "FileSource.h"
+
+using namespace std;
+
+class Prefetcher
+{
+	public:
+		/**
+		 * A file, loaded by next() or fetch(). image is NULL if it could not be loaded, or if its mask is required and missing.
+		 */
+		struct Item
+		{
+			string file;
+			IplImage* image;
+			ImageLabels labels;
+			size_t bytes;
+			bool loaded;
+		};
+
+		Prefetcher(FileSource& files, int depth = 0, size_t budget = 0, int threads = 1);
+		~Prefetcher();
+
+		void setImageSize(CvSize size, bool exact = false);
+		void setMasks(CvSize size, int iscolor, bool required);
+		void setTexts(bool load = true) {_texts = load;}
+
+		Item* next();
+		void fetch(Item* item);
+		void release(Item* item);
+
+	private:
+		static void* loaderMain(void* arg);
+		void loader();
+		Item* load(const string& file, bool now = true) const;
+
+		FileSource& _files;
+		int _depth, _threads;
+		size_t _budget;
+		CvSize _imageSize, _maskSize;
+		bool _exact, _masks, _maskRequired, _texts;
+		int _maskColor;
+
+		bool _started, _stopping, _exhausted;
+		long _dispatched, _taken;
+		size_t _bytes;
+		map<long, Item*> _ready;
+		vector<pthread_t> _loaders;
+		pthread_mutex_t _lock;
+		pthread_cond_t _readyCond, _spaceCond;
+
+		Prefetcher(const Prefetcher&);
+		Prefetcher& operator=(const Prefetcher&);
+};
+
+#endif
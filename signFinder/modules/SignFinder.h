@@ -34,13 +34,31 @@
  */
 
 #include <string>
+#include <iostream>
 #include "lib/histogramtool/histogramTool.h"
+#include "lib/histogramtool/bayesDetector.h"
+#include "lib/histogramtool/histogramModel.h"
 #include "lib/bloblib/Blob.h"
 #include "lib/bloblib/BlobResult.h"
+#include "lib/bloblib/BlobLabeller.h"
+#include "FrameContext.h"
+#include "CornerFinder.h"
 #include "OpenSURF/surflib.h"
 
 using namespace std;
 
+class OCREngine;
+struct ImageLabels;
+
+/**
+ * Finds and reads street signs.
+ *
+ * A SignFinder is the shared model: histograms, thresholds and the optional SURF database.
+ * Configure it with the setters before use; after that it is read-only, and one instance can
+ * serve any number of threads through readSigns(Context&, ...), with one Context per thread.
+ * The readSigns(file, result) shorthand uses a context that is owned by the SignFinder itself,
+ * and is therefore not thread-safe.
+ */
 class SignFinder
 {
 	public:
@@ -63,15 +81,93 @@ class SignFinder
 			}
 		};
 
+		/**
+		 * Decision boundaries of the blob classifier. A blob is a street-sign candidate when it covers at least
+		 * _minArea of the image, and a blob shaped like a street-sign when none of its shape features is below its bound.
+		 */
+		struct BlobBounds
+		{
+			double _minArea, _minSquareness, _minXYratio, _minWHratio;
+			BlobBounds()
+			{
+				_minArea = 1. / 450, _minSquareness = 0.70, _minXYratio = 0.45, _minWHratio = 2.5;
+			}
+			bool accepts(double squareness, double XYratio, double WHratio) const
+			{
+				return !((squareness < _minSquareness) || (XYratio < _minXYratio) || WHratio < _minWHratio);
+			}
+			int minPixels(CvSize size) const {return (int) (size.width * size.height * _minArea);}
+		};
+
+		/**
+		 * A street sign found by readImage or readSigns, and its text. readImage gives the corners in the
+		 * frame the sign was found in, readSigns in the frame of the caller.
+		 */
+		struct Sign
+		{
+			CvPoint corners[4];
+			string text;
+		};
+
+		/** Result of readSigns on a frame in memory. */
+		enum Status { STATUS_OK = 0, STATUS_INVALID_BUFFER, STATUS_INVALID_VIS };
+
+		/**
+		 * Ways to find the four corners of a detected sign: good-features-to-track on the filled convex hull
+		 * of the blob (see findCorners), or a quadrilateral fitted to the points of the hull (see fitQuadrilateral).
+		 */
+		enum CornerEngine { CORNERS_FEATURES, CORNERS_QUADFIT };
+
+		/**
+		 * Per-call / per-thread state: scratch images, planes derived from the current frame,
+		 * labeller and corner finder buffers that are reused between calls, the OCR engine, performance metrics, and the stream that per-image messages go to.
+		 */
+		class Context
+		{
+			public:
+				Context();
+				~Context();
+
+				void merge(const Context& other);
+				void setLog(ostream* log) {_log = log;}
+				/** Labels of the image of the next call, loaded in advance. NULL reads them from <file>_mask.png and <file>.txt. */
+				void setLabels(const ImageLabels* labels) {_labels = labels;}
+				OCREngine* ocr();
+
+				DetectPerformance _detperf;
+				OcrPerformance _ocrperf;
+				ostream* _log;
+
+			protected:
+				friend class SignFinder;
+				IplImage* scratch(IplImage*& slot, CvSize size, int depth, int channels);
+
+				IplImage* _resized;
+				IplImage* _result;
+				IplImage* _histMatched;
+				FrameContext _frame;
+				CBlobLabeller _labeller;
+				CornerScratch _corners;
+				OCREngine* _ocr;
+				const ImageLabels* _labels;
+
+			private:
+				Context(const Context&);
+				Context& operator=(const Context&);
+		};
+
 	private:
 		bool _debug, _showPerformance;
 		double _histThreshold;
+		BlobBounds _bounds;
+		CornerEngine _cornerEngine;
 		CvHistogram* _posHist;
 		CvHistogram* _negHist;
+		HistogramModel _model;
+		BayesDetector _detector;
 		IpVec _surfpoints;
-		DetectPerformance _detperf;
-		OcrPerformance _ocrperf;
 		int XRES, YRES;
+		Context _context;
 
 	/* public interface */
 	public:
@@ -79,14 +175,32 @@ class SignFinder
 		~SignFinder();
 
 		string readSigns(char* file, IplImage* result = NULL);
-		void performanceMeasurements();
+		string readSigns(Context& ctx, char* file, IplImage* result = NULL) const;
+		string readImage(Context& ctx, char* file, IplImage* img, IplImage* result = NULL, vector<Sign>* signs = NULL) const;
+		Status readSigns(Context& ctx, const unsigned char* bgr, int width, int height, int stride, vector<Sign>& signs, IplImage* vis = NULL) const;
+		void performanceMeasurements() const;
+		void performanceMeasurements(const Context& ctx) const;
+		void mergePerformance(const Context& ctx) {_context.merge(ctx);}
+		bool findCandidates(Context& ctx, char* file, double minArea, CBlobResult& candidates, CvSize& size) const;
+		static void blobShape(const CBlobFeatures& features, double& squareness, double& XYratio, double& WHratio);
 
 	/* getters and setters*/
-		void setThreshold(double thr) {_histThreshold = thr;}
+		void setThreshold(double thr) {_histThreshold = thr; _detector.setThreshold(thr);}
 		void setRes(int x, int y) {XRES = x; YRES=y;}
+		CvSize getRes() const {return cvSize(XRES,YRES);}
 		void disableResize() {setRes(0,0);}
 		void setDebug(bool dbg=true) {_debug = dbg;}
 		void setShowPerformance(bool show=true) {_showPerformance = show;}
+		void setBlobBounds(const BlobBounds& bounds) {_bounds = bounds;}
+		const BlobBounds& getBlobBounds() const {return _bounds;}
+		void setCornerEngine(CornerEngine engine) {_cornerEngine = engine;}
+		CornerEngine getCornerEngine() const {return _cornerEngine;}
+		void setLog(ostream* log) {_context.setLog(log);}
+
+	/* detector model bundle */
+		bool saveModel(const char* filename) const;
+		bool loadModel(const char* filename);
+		void useHistograms();
 
 	/* support functions*/
 	protected:
@@ -94,13 +208,18 @@ class SignFinder
 		void cleanup();
 		void loadHistograms();
 		void loadSurf();
-		IplImage* resize(IplImage* img);
-		IplImage* histMatch(IplImage* img, IplImage* vis=NULL);
-		void processSurf(IplImage* img);
-		CBlobResult classifyBlobs(CBlobResult& blobs, char* file, CvSize size, IplImage* vis=NULL);
-		string processBlob(CBlob* currentBlob, char* file, IplImage* result, int& prevY, IplImage* histMatchVis);
-		void drawConvexHull(CBlob* blob, IplImage* img, int i);
-		
+		IplImage* resize(Context& ctx, IplImage* img) const;
+		IplImage* histMatch(Context& ctx, IplImage* img, IplImage* vis=NULL) const;
+		string readFrame(Context& ctx, char* file, IplImage* img, IplImage* result, vector<Sign>* signs) const;
+		void processSurf(Context& ctx, IplImage* vis) const;
+		CBlobResult classifyBlobs(Context& ctx, const CBlobLabeller& components, char* file, CvSize size, IplImage* vis=NULL) const;
+		void classifyFeatures(const vector<CBlobFeatures>& features, vector<bool>& accepted) const;
+		string processBlob(Context& ctx, CBlob* currentBlob, char* file, IplImage* result, int& prevY, IplImage* histMatchVis, vector<Sign>* signs) const;
+		void drawConvexHull(CBlob* blob, IplImage* img, int i) const;
+
+	private:
+		SignFinder(const SignFinder&);
+		SignFinder& operator=(const SignFinder&);
 
 };
 
@@ -0,0 +1,168 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is SocketIO.cpp .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+/*
+ * Blocking reads and writes on the Unix domain sockets between signFinderd
+ * and its clients. See README.daemon for the protocol.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "SocketIO.h"
+
+/* Fills in the address of a socket at path. @return false if the path is too long. */
+static bool unixAddress(const char* path, struct sockaddr_un& addr)
+{
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return false;
+	strcpy(addr.sun_path, path);
+	return true;
+}
+
+/**
+ * Creates a listening socket at path. A socket file that is left behind by an earlier run is replaced.
+ * @return the socket, or -1 on failure.
+ */
+int listenUnix(const char* path, int backlog)
+{
+	struct sockaddr_un addr;
+	if (!unixAddress(path, addr))
+		return -1;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	unlink(path);
+	if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(fd, backlog) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * Connects to the socket at path.
+ * @return the connection, or -1 on failure.
+ */
+int connectUnix(const char* path)
+{
+	struct sockaddr_un addr;
+	if (!unixAddress(path, addr))
+		return -1;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * Reads a line, without its newline. Reads one byte at a time, so that nothing after the line is consumed.
+ * @return false at the end of the stream, on an error, or if the line is longer than maxLength.
+ */
+bool readLine(int fd, string& line, size_t maxLength)
+{
+	line.clear();
+	char c;
+	while (true)
+	{
+		ssize_t n = read(fd, &c, 1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		if (c == '\n')
+			return true;
+		if (line.size() >= maxLength)
+			return false;
+		line += c;
+	}
+}
+
+/**
+ * Reads exactly size bytes.
+ * @return false if the stream ends before that.
+ */
+bool readFully(int fd, vector<char>& data, size_t size)
+{
+	data.resize(size);
+	size_t done = 0;
+	while (done < size)
+	{
+		ssize_t n = read(fd, &data[done], size - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+/**
+ * Writes exactly size bytes.
+ * @return false if the other side went away.
+ */
+bool writeFully(int fd, const void* data, size_t size)
+{
+	const char* p = (const char*) data;
+	size_t done = 0;
+	while (done < size)
+	{
+		ssize_t n = write(fd, p + done, size - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+/** Writes a line, and its newline. */
+bool writeLine(int fd, const string& line)
+{
+	string out = line + "\n";
+	return writeFully(fd, out.data(), out.size());
+}
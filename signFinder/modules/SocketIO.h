@@ -0,0 +1,20 @@
+/* 
+ * See .cpp file for more information
+ */
+
+#ifndef SOCKETIO_H
+#define SOCKETIO_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int listenUnix(const char* path, int backlog);
+int connectUnix(const char* path);
+bool readLine(int fd, string& line, size_t maxLength = 4096);
+bool readFully(int fd, vector<char>& data, size_t size);
+bool writeFully(int fd, const void* data, size_t size);
+bool writeLine(int fd, const string& line);
+
+#endif
@@ -37,6 +37,8 @@ const bool _debug = false;
 
 #include <stdio.h>
 #include <math.h>
+#include <limits.h>
+#include <vector>
 #include <iostream>
 #include <fstream>
 #include "TestHandler.h"
@@ -82,6 +84,18 @@ double compareMasks(IplImage* estimation, IplImage* label, double* _fp)
 	return tp;
 }
 
+/**
+ * Judges a blob on its true positive fraction of the label, and its false positive surface relative to the label surface.
+ */
+static bool blobCorrect(double tp, double fp, double numBlobs)
+{
+	if ((tp * numBlobs) > 0.60) // At least 90% of the label is matched.
+		if (fp < (0.25 / numBlobs)) // the 'false positive' area is at most 25% bigger than the label.
+			return true;
+
+	return false;
+}
+
 /**
  * Judges whether a blob corresponds to a known-correct label.
  * @return bool whether blob has been detected correctly or not
@@ -100,14 +114,9 @@ bool blobCorrect(IplImage* blob, IplImage* label, double numBlobs = 1)
 
 	fp = fp * (blob->width * blob->height) / labelSurface;
 
-	if ((tp * numBlobs) > 0.60) // At least 90% of the label is matched.
-		if (fp < (0.25 / numBlobs)) // the 'false positive' area is at most 25% bigger than the label.
-			return true;
-
-	return false;
+	return blobCorrect(tp, fp, numBlobs);
 }
 
-
 /**
  * Fills an image with a convex hull as described by a CvSeq
  */
@@ -131,68 +140,219 @@ void fillConvexHull(IplImage* img, CBlob* blob, CvScalar color)
 }
 
 
-/* This function judges whether detected blobs corresponds with one of the known-correct labeled area's */
-bool checkLabeledBlobs(CBlobResult& detectedBlobs, CvSize origImg, char* file, int& fp, int& fn, int& multipleDetections, CBlobResult* correctBlobsOut, CBlobResult* incorrectBlobsOut)
+/**
+ * The pixels of a filled convex hull, as horizontal spans in raster order.
+ */
+struct HullSpans
+{
+	struct Span
+	{
+		int y, xs, xe; // xe inclusive
+	};
+
+	CvRect bbox;
+	vector<Span> spans;
+	long area;
+};
+
+/**
+ * Rasterises a convex hull once, into the spans of its pixels within the frame.
+ * The hull is filled with cvFillConvexPoly in an image the size of its bounding box, so the pixels are the
+ * same as those of fillConvexHull on a full frame.
+ * @param scale factor to scale the hull points with, for hulls found on an image of another size than the frame.
+ */
+static void rasteriseHull(CvSeq* hull, CvSize frame, double scaleX, double scaleY, HullSpans& out)
+{
+	out.spans.clear();
+	out.area = 0;
+	out.bbox = cvRect(0,0,0,0);
+	if (!hull || hull->total == 0)
+		return;
+
+	vector<CvPoint> points(hull->total);
+	int minx = INT_MAX, miny = INT_MAX, maxx = INT_MIN, maxy = INT_MIN;
+	for (int j=0; j< hull->total; ++j)
+	{
+		CvPoint p = **CV_GET_SEQ_ELEM( CvPoint*, hull, j );
+		if (scaleX != 1 || scaleY != 1)
+			p = cvPoint(cvRound(p.x * scaleX), cvRound(p.y * scaleY));
+		points[j] = p;
+		minx = MIN(minx, p.x); maxx = MAX(maxx, p.x);
+		miny = MIN(miny, p.y); maxy = MAX(maxy, p.y);
+	}
+
+	IplImage* fill = cvCreateImage(cvSize(maxx - minx + 1, maxy - miny + 1), IPL_DEPTH_8U, 1);
+	cvZero(fill);
+	for (unsigned int j=0; j < points.size(); ++j)
+		points[j] = cvPoint(points[j].x - minx, points[j].y - miny);
+	cvFillConvexPoly(fill,&points[0],points.size(),cvScalar(255));
+
+	// Collect the spans, clipped to the frame.
+	int x0 = MAX(minx, 0), x1 = MIN(maxx, frame.width - 1);
+	int y0 = MAX(miny, 0), y1 = MIN(maxy, frame.height - 1);
+	for (int y = y0; y <= y1; ++y)
+	{
+		const uchar* row = (const uchar*)(fill->imageData + (y - miny) * fill->widthStep) - minx;
+		int x = x0;
+		while (x <= x1)
+		{
+			while (x <= x1 && !row[x]) ++x;
+			if (x > x1) break;
+			HullSpans::Span span;
+			span.y = y;
+			span.xs = x;
+			while (x <= x1 && row[x]) ++x;
+			span.xe = x - 1;
+			out.spans.push_back(span);
+			out.area += span.xe - span.xs + 1;
+		}
+	}
+	if (x0 <= x1 && y0 <= y1)
+		out.bbox = cvRect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+
+	cvReleaseImage(&fill);
+}
+
+/**
+ * Rasterises the convex hull around the pixels in a blob.
+ */
+static void rasteriseHull(CBlob* blob, CvSize frame, double scaleX, double scaleY, HullSpans& out)
+{
+	CvSeq* hull;
+        blob->GetConvexHull(&hull);
+	rasteriseHull(hull, frame, scaleX, scaleY, out);
+}
+
+/**
+ * Number of pixels that two rasterised hulls have in common.
+ */
+static long hullOverlap(const HullSpans& a, const HullSpans& b)
+{
+	// Hulls whose bounding boxes don't touch have nothing in common.
+	if (a.bbox.x >= b.bbox.x + b.bbox.width || b.bbox.x >= a.bbox.x + a.bbox.width ||
+	    a.bbox.y >= b.bbox.y + b.bbox.height || b.bbox.y >= a.bbox.y + a.bbox.height)
+		return 0;
+
+	// Merge the two span lists; both are sorted on row, then on column.
+	long overlap = 0;
+	unsigned int i = 0, j = 0;
+	while (i < a.spans.size() && j < b.spans.size())
+	{
+		const HullSpans::Span& sa = a.spans[i];
+		const HullSpans::Span& sb = b.spans[j];
+		if (sa.y != sb.y)
+		{
+			if (sa.y < sb.y) ++i; else ++j;
+			continue;
+		}
+		int xs = MAX(sa.xs, sb.xs), xe = MIN(sa.xe, sb.xe);
+		if (xe >= xs)
+			overlap += xe - xs + 1;
+		if (sa.xe < sb.xe) ++i; else ++j;
+	}
+	return overlap;
+}
+
+/** Loads the known-correct mask of an image, <file>_mask.png. @return NULL if there is none. */
+static IplImage* loadLabeledMask(char* file)
 {
-	// See if we can find a mask for this file.
         string maskfile(file);
         IplImage* labeledMask = cvLoadImage((maskfile+"_mask.png").c_str());
+	if (!labeledMask && _debug)
+		cerr << "Warning:: Couldn't open mask " << maskfile << endl;
+	return labeledMask;
+}
+
+/**
+ * Matches detected blobs with the known-correct labeled area's of an image.
+ * @param matches receives for every detected blob the indices of the labeled blobs it corresponds with.
+ * @param numLabels receives the number of labeled blobs.
+ * @return false if there's no mask for the file.
+ */
+bool matchLabeledBlobs(CBlobResult& detectedBlobs, CvSize origImg, char* file, vector<vector<int> >& matches, int& numLabels)
+{
+	// See if we can find a mask for this file.
+	IplImage* labeledMask = loadLabeledMask(file);
 	if (!labeledMask)
-	{
-		if (_debug) cerr << "Warning:: Couldn't open mask " << maskfile << endl;
 		return false;
-	}
 
+	matchLabeledBlobs(detectedBlobs, origImg, labeledMask, matches, numLabels);
+	cvReleaseImage(&labeledMask);
+	return true;
+}
+
+/**
+ * Matches detected blobs with the labeled area's of an already loaded (3 channel) mask.
+ */
+void matchLabeledBlobs(CBlobResult& detectedBlobs, CvSize origImg, IplImage* labeledMask, vector<vector<int> >& matches, int& numLabels)
+{
 	// Detect the blobs in the mask.
         IplImage* labeledMaskbw = cvCreateImage(cvGetSize(labeledMask), IPL_DEPTH_8U, 1);
 	cvCvtColor(labeledMask, labeledMaskbw, CV_RGB2GRAY);
 	CBlobResult maskblobs = CBlobResult( labeledMaskbw, NULL, 0, false );
 
 	// filter blobs 
-	maskblobs.Filter( maskblobs , B_EXCLUDE, CBlobGetArea(), B_LESS, (labeledMask->height*labeledMask->width) / 1000 ); 
+	CBlobFilter filter;
+	filter.Add( B_EXCLUDE, CBlobGetArea(), B_LESS, (labeledMask->height*labeledMask->width) / 1000 ); 
         // Blobs not in contact with sides of image.
-        maskblobs.Filter( maskblobs, B_EXCLUDE, CBlobGetMinX(), B_EQUAL, 0);
-        maskblobs.Filter( maskblobs, B_EXCLUDE, CBlobGetMaxX(), B_EQUAL, labeledMask->width-1);
-        maskblobs.Filter( maskblobs, B_EXCLUDE, CBlobGetMinY(), B_EQUAL, 0);
-        maskblobs.Filter( maskblobs, B_EXCLUDE, CBlobGetMaxY(), B_EQUAL, labeledMask->height-1);
-
-	int correctMaskBlobs[maskblobs.GetNumBlobs()];
-	for (int i=0; i<maskblobs.GetNumBlobs(); ++i)
-		correctMaskBlobs[i]=0;
-        IplImage* detectedMask = cvCreateImage(origImg, IPL_DEPTH_8U, 3);
+        filter.Add( B_EXCLUDE, CBlobGetMinX(), B_EQUAL, 0);
+        filter.Add( B_EXCLUDE, CBlobGetMaxX(), B_EQUAL, labeledMask->width-1);
+        filter.Add( B_EXCLUDE, CBlobGetMinY(), B_EQUAL, 0);
+        filter.Add( B_EXCLUDE, CBlobGetMaxY(), B_EQUAL, labeledMask->height-1);
+	maskblobs.Filter( filter );
+
+	// Rasterise every convex hull once. The labeled hulls are scaled to the size of the image the blobs were detected in.
+	double scaleX = (double) origImg.width / labeledMask->width;
+	double scaleY = (double) origImg.height / labeledMask->height;
+	vector<HullSpans> detectedHulls(detectedBlobs.GetNumBlobs());
+	for (int i = 0; i < detectedBlobs.GetNumBlobs(); ++i)
+		rasteriseHull(detectedBlobs.GetBlob(i), origImg, 1, 1, detectedHulls[i]);
+	vector<HullSpans> maskHulls(maskblobs.GetNumBlobs());
+	for (int i = 0; i < maskblobs.GetNumBlobs(); ++i)
+		rasteriseHull(maskblobs.GetBlob(i), origImg, scaleX, scaleY, maskHulls[i]);
 
 	// Iterate through each of the blobs in each of the mask, to see if they correspond.
+	matches.assign(detectedBlobs.GetNumBlobs(), vector<int>());
 	for (int detectedBlobI = 0; detectedBlobI < detectedBlobs.GetNumBlobs(); ++detectedBlobI)
 	{
-		bool blobFound = false;
+		const HullSpans& detected = detectedHulls[detectedBlobI];
 		for (int maskBlobI = 0; maskBlobI < maskblobs.GetNumBlobs(); ++maskBlobI)
 		{
-			// fill a mask for the detected blob by filling the convex hull.
-			cvSet(detectedMask,cvScalar(0,0,0));
-			fillConvexHull(detectedMask,detectedBlobs.GetBlob(detectedBlobI),CV_RGB(255,255,255));
-
-			// fill a mask for the labeled blob by filling the convex hull, we're re-using the labeledMask.
-			cvSet(labeledMask,cvScalar(0,0,0));
-			fillConvexHull(labeledMask,maskblobs.GetBlob(maskBlobI),CV_RGB(255,255,255));
-						
+			const HullSpans& label = maskHulls[maskBlobI];
+			long tpSurface = hullOverlap(detected, label);
+			// Without overlap, none of the label is matched.
+			if (!tpSurface)
+				continue;
+
 			// check for correspondence.
-			if (blobCorrect(detectedMask, labeledMask))
-			{
-				blobFound = true;
-				++correctMaskBlobs[maskBlobI];
-				if (correctBlobsOut)
-					correctBlobsOut->AddBlob(detectedBlobs.GetBlob(detectedBlobI));
-			}
+			double tp = (double) tpSurface / label.area;
+			double fpSurface = (double) (detected.area - tpSurface) / label.area;
+			if (blobCorrect(tp, fpSurface, 1))
+				matches[detectedBlobI].push_back(maskBlobI);
 		}
-		
-		if ((!blobFound) && incorrectBlobsOut)
-			incorrectBlobsOut->AddBlob(detectedBlobs.GetBlob(detectedBlobI));
 	}
+	numLabels = maskblobs.GetNumBlobs();
+
+	// Cleanup
+	cvReleaseImage(&labeledMaskbw);
+}
+
+/**
+ * Counts the errors of a detection, given the labeled blobs every detected blob corresponds with.
+ */
+void countDetectionErrors(const vector<vector<int> >& matches, int numLabels, int& fp, int& fn, int& multipleDetections)
+{
+	int correctMaskBlobs[numLabels];
+	for (int i=0; i<numLabels; ++i)
+		correctMaskBlobs[i]=0;
+	for (unsigned int i=0; i<matches.size(); ++i)
+		for (unsigned int j=0; j<matches[i].size(); ++j)
+			++correctMaskBlobs[matches[i][j]];
 
 	int correctMaskBlobsCnt = 0;
 	int correctDetectedBlobsSum = 0;
 	// Calculate false-positives and false-negatives.
-	for (int i=0; i<maskblobs.GetNumBlobs(); ++i)
+	for (int i=0; i<numLabels; ++i)
 	{
 		correctDetectedBlobsSum += correctMaskBlobs[i];
 		if (correctMaskBlobs[i])
@@ -200,25 +360,61 @@ bool checkLabeledBlobs(CBlobResult& detectedBlobs, CvSize origImg, char* file, i
 	}
 	
 	multipleDetections = correctDetectedBlobsSum - correctMaskBlobsCnt;	
-	fp = detectedBlobs.GetNumBlobs() - correctDetectedBlobsSum;
-	fn = maskblobs.GetNumBlobs() - correctMaskBlobsCnt;	
+	fp = matches.size() - correctDetectedBlobsSum;
+	fn = numLabels - correctMaskBlobsCnt;	
+}
 
-	// Cleanup
-	cvReleaseImage(&detectedMask);
-	cvReleaseImage(&labeledMaskbw);
+/* This function judges whether detected blobs corresponds with one of the known-correct labeled area's */
+bool checkLabeledBlobs(CBlobResult& detectedBlobs, CvSize origImg, char* file, int& fp, int& fn, int& multipleDetections, CBlobResult* correctBlobsOut, CBlobResult* incorrectBlobsOut)
+{
+	IplImage* labeledMask = loadLabeledMask(file);
+	if (!labeledMask)
+		return false;
+
+	checkLabeledBlobs(detectedBlobs, origImg, labeledMask, fp, fn, multipleDetections, correctBlobsOut, incorrectBlobsOut);
+	cvReleaseImage(&labeledMask);
 	return true;
 }
 
+/* The same, against the labeled area's of an already loaded mask. */
+void checkLabeledBlobs(CBlobResult& detectedBlobs, CvSize origImg, IplImage* labeledMask, int& fp, int& fn, int& multipleDetections, CBlobResult* correctBlobsOut, CBlobResult* incorrectBlobsOut)
+{
+	vector<vector<int> > matches;
+	int numLabels;
+	matchLabeledBlobs(detectedBlobs, origImg, labeledMask, matches, numLabels);
+
+	for (int i = 0; i < detectedBlobs.GetNumBlobs(); ++i)
+	{
+		// A blob that corresponds with more than one label is added once per label.
+		if (correctBlobsOut)
+			for (unsigned int j = 0; j < matches[i].size(); ++j)
+				correctBlobsOut->AddBlob(detectedBlobs.GetBlob(i));
+		if (matches[i].empty() && incorrectBlobsOut)
+			incorrectBlobsOut->AddBlob(detectedBlobs.GetBlob(i));
+	}
+
+	countDetectionErrors(matches, numLabels, fp, fn, multipleDetections);
+}
+
 /**
  * Compares the OCRed text from a streetsign with known-correct labels if present
  */
 int compareText(string detected, char* imgfile)
 {
-	string label;	
-
 	// read labeled text from file;
 	string textfile(imgfile);
         ifstream ifs((textfile+=".txt").c_str());
+	int mindist = compareText(detected, ifs);
+	ifs.close();
+	return mindist;
+}
+
+/**
+ * Compares the OCRed text with the labels in a stream, one street name per line.
+ */
+int compareText(string detected, istream& ifs)
+{
+	string label;	
 
 	// For multiple signs, assume that the reading with the lowerst edit-distance is the actual correct one.
 	int mindist = 1000;	
@@ -240,7 +436,6 @@ int compareText(string detected, char* imgfile)
 			mindist = dist;
 	}
 
-	ifs.close();
 	return mindist; // 1000 if error occured.
 
 	
@@ -2,14 +2,30 @@
  * See .cpp file for more information
  */
 
+#ifndef TESTHANDLER_H
+#define TESTHANDLER_H
+
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
 #include "lib/bloblib/Blob.h"
 #include "lib/bloblib/BlobResult.h"
 #include <string>
+#include <vector>
+#include <istream>
 
 using namespace std;
 
+/**
+ * Known-correct labels of an image, loaded ahead of processing: the <file>_mask.png mask (NULL if there
+ * is none) and the contents of <file>.txt (empty if there is none).
+ */
+struct ImageLabels
+{
+	IplImage* mask;
+	string text;
+	ImageLabels() {mask = NULL;}
+};
+
 
 double compareMasks(IplImage* estimation, IplImage* label, double* _fp = NULL);
 bool blobCorrect(IplImage* blob, IplImage* label,double numBlobs);
@@ -17,11 +33,17 @@ bool blobCorrect(IplImage* blob, IplImage* label,double numBlobs);
 void fillConvexHull(IplImage* img, CvSeq* hull, CvScalar color);
 void fillConvexHull(IplImage* img, CBlob* blob, CvScalar color);
 
+bool matchLabeledBlobs(CBlobResult& detectedBlobs, CvSize origImg, char* file, vector<vector<int> >& matches, int& numLabels);
+void matchLabeledBlobs(CBlobResult& detectedBlobs, CvSize origImg, IplImage* labeledMask, vector<vector<int> >& matches, int& numLabels);
+void countDetectionErrors(const vector<vector<int> >& matches, int numLabels, int& fp, int& fn, int& multipleDetections);
 bool checkLabeledBlobs(CBlobResult& detectedBlobs, CvSize origImg, char* file, int& fp, int& fn, int& multipleDetections, CBlobResult* correctBlobsOut = NULL, CBlobResult* incorrectBlobsOut = NULL);
+void checkLabeledBlobs(CBlobResult& detectedBlobs, CvSize origImg, IplImage* labeledMask, int& fp, int& fn, int& multipleDetections, CBlobResult* correctBlobsOut = NULL, CBlobResult* incorrectBlobsOut = NULL);
 
 int compareText(string detected, char* imgfile);
+int compareText(string detected, istream& labels);
 
 /* Support Functions */
 int levenshtein(const char* a, const char* b);
 string trim(string in);
 
+#endif
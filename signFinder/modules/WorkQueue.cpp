@@ -0,0 +1,174 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is WorkQueue.cpp .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+/*
+ * A small pool of worker threads that processes a stream of jobs in parallel,
+ * but hands the results back in the order the jobs were produced.
+ * Used to spread the per-file work of the command line tools over all cores,
+ * while their output stays identical to a sequential run.
+ */
+
+#include "WorkQueue.h"
+
+/**
+ * @param threads : number of worker threads. With 1 or less, run() does all work on the calling thread.
+ * @param window : maximum number of jobs that are produced but not yet consumed. This bounds memory
+ *                 use when one slow job holds up the ordered output. Defaults to 4 jobs per thread.
+ */
+WorkQueue::WorkQueue(int threads, int window)
+{
+	_threads = (threads < 1) ? 1 : threads;
+	_window = (window > 0) ? window : 4 * _threads;
+	_nextWorker = 0;
+	_exhausted = false;
+	_produced = _consumed = 0;
+	pthread_mutex_init(&_lock, NULL);
+	pthread_mutex_init(&_produceLock, NULL);
+	pthread_cond_init(&_doneCond, NULL);
+	pthread_cond_init(&_spaceCond, NULL);
+}
+
+WorkQueue::~WorkQueue()
+{
+	pthread_cond_destroy(&_spaceCond);
+	pthread_cond_destroy(&_doneCond);
+	pthread_mutex_destroy(&_produceLock);
+	pthread_mutex_destroy(&_lock);
+}
+
+/**
+ * Process all jobs, and return when the last one has been consumed.
+ */
+void WorkQueue::run()
+{
+	if (_threads == 1)
+	{
+		void* job;
+		while ((job = produce()))
+		{
+			process(job, 0);
+			consume(job);
+		}
+		return;
+	}
+
+	_exhausted = false;
+	_nextWorker = 0;
+	vector<pthread_t> workers(_threads);
+	for (int i = 0; i < _threads; ++i)
+		pthread_create(&workers[i], NULL, workerMain, this);
+
+	// Consume the jobs in order, as they finish.
+	pthread_mutex_lock(&_lock);
+	while (true)
+	{
+		while (!(_pending.size() && _pending.front().done) && !(_pending.empty() && _exhausted))
+			pthread_cond_wait(&_doneCond, &_lock);
+		if (_pending.empty())
+			break;
+
+		void* job = _pending.front().job;
+		_pending.pop_front();
+		++_consumed;
+		pthread_cond_broadcast(&_spaceCond);
+
+		pthread_mutex_unlock(&_lock);
+		consume(job);
+		pthread_mutex_lock(&_lock);
+	}
+	pthread_mutex_unlock(&_lock);
+
+	for (int i = 0; i < _threads; ++i)
+		pthread_join(workers[i], NULL);
+}
+
+void* WorkQueue::workerMain(void* arg)
+{
+	WorkQueue* queue = (WorkQueue*) arg;
+	pthread_mutex_lock(&queue->_lock);
+	int worker = queue->_nextWorker++;
+	pthread_mutex_unlock(&queue->_lock);
+
+	queue->work(worker);
+	return NULL;
+}
+
+/**
+ * Worker loop: take the next job from the producer, process it, and mark it done.
+ * One worker at a time produces, under _produceLock, so the jobs are numbered in the order of production.
+ * The queue itself is only locked to wait for room in the window and to add the job.
+ */
+void WorkQueue::work(int worker)
+{
+	while (true)
+	{
+		pthread_mutex_lock(&_produceLock);
+		pthread_mutex_lock(&_lock);
+		while (!_exhausted && (_produced - _consumed >= _window))
+			pthread_cond_wait(&_spaceCond, &_lock);
+		bool exhausted = _exhausted;
+		pthread_mutex_unlock(&_lock);
+		if (exhausted)
+		{
+			pthread_mutex_unlock(&_produceLock);
+			break;
+		}
+
+		void* job = produce();
+
+		pthread_mutex_lock(&_lock);
+		if (!job)
+		{
+			_exhausted = true;
+			pthread_cond_broadcast(&_doneCond);
+			pthread_cond_broadcast(&_spaceCond);
+			pthread_mutex_unlock(&_lock);
+			pthread_mutex_unlock(&_produceLock);
+			break;
+		}
+		long seq = _produced++;
+		Slot slot = {job, false};
+		_pending.push_back(slot);
+		pthread_mutex_unlock(&_lock);
+		pthread_mutex_unlock(&_produceLock);
+
+		process(job, worker);
+
+		pthread_mutex_lock(&_lock);
+		_pending[seq - _consumed].done = true;
+		pthread_cond_broadcast(&_doneCond);
+		pthread_mutex_unlock(&_lock);
+	}
+}
@@ -0,0 +1,53 @@
+/* 
+ * See .cpp file for more information
+ */
+
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+class WorkQueue
+{
+	public:
+		WorkQueue(int threads, int window = 0);
+		virtual ~WorkQueue();
+
+		void run();
+		int numThreads() const {return _threads;}
+
+	protected:
+		/**
+		 * Returns the next job, or NULL when there is no more work. Called by one thread at a time,
+		 * without the lock of the queue, so it may block without holding up the other workers and the consumer.
+		 */
+		virtual void* produce() = 0;
+		/** Does the work for a job. Called concurrently on the worker threads. */
+		virtual void process(void* job, int worker) = 0;
+		/** Handles a finished job. Called on the thread that called run(), in the order of production. */
+		virtual void consume(void* job) = 0;
+
+	private:
+		struct Slot
+		{
+			void* job;
+			bool done;
+		};
+
+		static void* workerMain(void* arg);
+		void work(int worker);
+
+		int _threads, _window;
+		int _nextWorker;
+		bool _exhausted;
+		long _produced, _consumed;
+		deque<Slot> _pending;
+		pthread_mutex_t _lock, _produceLock;
+		pthread_cond_t _doneCond, _spaceCond;
+};
+
+#endif
@@ -35,15 +35,24 @@
 
 
 #include <iostream>
+#include <vector>
+#include <sstream>
+#include <string.h>
 #include "SignFinder.h"
 #include "modules/TestHandler.h"
 #include "modules/CornerFinder.h"
 #include "modules/SignHandler.h"
 #include "modules/OCRWrapper.h"
+#include "modules/ImageLoader.h"
 #include "OpenSURF/surflib.h"
 
 using namespace std;
 
+// Defaults, unless a detector model bundle sets them.
+const double HISTTHRESHOLD = 0.19;
+const int DEFAULT_XRES = 1600;
+const int DEFAULT_YRES = 1200;
+
 //#define SURF
 
 /** Constructor */
@@ -58,73 +67,153 @@ SignFinder::~SignFinder()
 	cleanup();
 }
 
+/** Context constructor */
+SignFinder::Context::Context()
+{
+	_log = &cout;
+	_resized = NULL;
+	_result = NULL;
+	_histMatched = NULL;
+	_ocr = NULL;
+	_labels = NULL;
+}
+
+/** Context destructor */
+SignFinder::Context::~Context()
+{
+	if (_resized)
+		cvReleaseImage(&_resized);
+	if (_result)
+		cvReleaseImage(&_result);
+	if (_histMatched)
+		cvReleaseImage(&_histMatched);
+	delete _ocr;
+}
+
 /**
- *  Filter Blobs based on statistics compared to other street-signs.
+ * The OCR engine of this context, initialised on first use.
  */
-CBlobResult SignFinder::classifyBlobs(CBlobResult& blobs, char* file, CvSize size, IplImage* img)
+OCREngine* SignFinder::Context::ocr()
 {
-	CBlobResult result;	
+	if (!_ocr)
+		_ocr = OCREngine::create();
+	return _ocr;
+}
 
-	// Pre-filtering
-	// Surface > 1/450th image surface.
-	blobs.Filter( blobs, B_EXCLUDE, CBlobGetArea(), B_LESS, (size.width * size.height) / 450 );
-	
-	// Blobs not in contact with sides of image. 
-	blobs.Filter( blobs, B_EXCLUDE, CBlobGetMinX(), B_EQUAL, 0);
-	blobs.Filter( blobs, B_EXCLUDE, CBlobGetMaxX(), B_EQUAL, size.width-1);
-	blobs.Filter( blobs, B_EXCLUDE, CBlobGetMinY(), B_EQUAL, 0);
-	blobs.Filter( blobs, B_EXCLUDE, CBlobGetMaxY(), B_EQUAL, size.height-1);
+/**
+ * Add the performance metrics gathered in another context (typically of a worker thread) to this one.
+ */
+void SignFinder::Context::merge(const Context& other)
+{
+	_detperf._fp += other._detperf._fp;
+	_detperf._fn += other._detperf._fn;
+	_detperf._multDetect += other._detperf._multDetect;
+	_detperf._imagesChecked += other._detperf._imagesChecked;
+	_detperf._imagesErr += other._detperf._imagesErr;
+
+	_ocrperf._OCRcorrect += other._ocrperf._OCRcorrect;
+	_ocrperf._signsChecked += other._ocrperf._signsChecked;
+	_ocrperf._editDist += other._ocrperf._editDist;
+}
 
-	// Iterate through the blobs, and accept or reject them based on statistical features.
-	CBlob* currentBlob = NULL;
-	for (int i = 0; i < blobs.GetNumBlobs(); ++i )
+/**
+ * Return the scratch image in the slot, (re)allocated if it doesn't have the requested format.
+ * The image stays owned by the context.
+ */
+IplImage* SignFinder::Context::scratch(IplImage*& slot, CvSize size, int depth, int channels)
+{
+	if (slot && (slot->width != size.width || slot->height != size.height || slot->depth != depth || slot->nChannels != channels))
+		cvReleaseImage(&slot);
+	if (!slot)
+		slot = cvCreateImage(size, depth, channels);
+	return slot;
+}
+
+/**
+ * The shape features the blob classifier decides on, see BlobBounds.
+ */
+void SignFinder::blobShape(const CBlobFeatures& f, double& squareness, double& XYratio, double& WHratio)
+{
+	// ellipse
+	double width = f.ellipse.size.height;
+	double height = f.ellipse.size.width;
+
+	double diffX = f.maxx - f.minx;
+	double diffY = f.maxy - f.miny;
+	XYratio = diffX / diffY; // > 1 means wider than long along the x-axis.
+	WHratio = width / height; 
+	squareness = f.area / (width * height);
+}
+
+/**
+ * Classify a batch of blob features: accepted[i] tells whether blob i has the shape of a street-sign.
+ */
+void SignFinder::classifyFeatures(const vector<CBlobFeatures>& features, vector<bool>& accepted) const
+{
+	accepted.resize(features.size());
+	for (unsigned int i = 0; i < features.size(); ++i)
 	{
-        	currentBlob = blobs.GetBlob(i);
-	
-		CBlobGetRoughness rn;
-		CBlobGetElongation el;
-		// ellipse
-		CBlobGetMajorAxisLength ma;
-		CBlobGetMinorAxisLength mi;
-		CBlobGetOrientation ori;
-		CBlobGetAxisRatio ar;
-
-		double area = currentBlob->Area();
-		double roughness = rn(*currentBlob);
-		double diffX = currentBlob->MaxX() - currentBlob->MinX();
-		double diffY = currentBlob->MaxY() - currentBlob->MinY();
-		double width = mi(*currentBlob);
-		double height = ma(*currentBlob);
-		double XYratio = diffX / diffY; // > 1 means wider than long along the x-axis.
-		double WHratio = ar(*currentBlob); 
-		double orientation = ori(*currentBlob);
-		double squareness = area / (width * height);
-		
+		const CBlobFeatures& f = features[i];
+		double squareness, XYratio, WHratio;
+		blobShape(f, squareness, XYratio, WHratio);
+
 		if (_debug)
+		{
+			double width = f.ellipse.size.height;
+			double height = f.ellipse.size.width;
+			double orientation = ((f.ellipse.angle > 180.0) ? f.ellipse.angle - 180.0 : f.ellipse.angle) * DEGREE2RAD;
+			double roughness = (f.hullPerimeter != 0.0) ? f.perimeter / f.hullPerimeter : 0.0;
 			fprintf	(stderr, "Blob %d - area: %f, width x height: %fx%f, orientation:%f, x/y ratio: %f, w/h ratio: %f, rougness: %f, squareness: %f",
-			 i,area,width,height,orientation,XYratio,WHratio,roughness,squareness);	
+			 i,f.area,width,height,orientation,XYratio,WHratio,roughness,squareness);	
+		}
 
 		// Classify
-		if ((squareness < 0.70) || (XYratio < 0.45) || WHratio < 2.5) 
-		{
-				
-			if (_debug) cerr << "  Rejected\n";
-			// make rejected blobs black.
-			if (img)
-				currentBlob->FillBlob(img,CV_RGB(0,0,0));
+		accepted[i] = _bounds.accepts(squareness, XYratio, WHratio);
+		if (_debug)
+			cerr << (accepted[i] ? "  Accepted\n" : "  Rejected\n");
+	}
+}
 
-		}
-		else
-		{
-			if (_debug) cout << "  Accepted\n";
-			result.AddBlob(currentBlob);
-		}
+/**
+ *  Filter Blobs based on statistics compared to other street-signs.
+ */
+CBlobResult SignFinder::classifyBlobs(Context& ctx, const CBlobLabeller& components, char* file, CvSize size, IplImage* img) const
+{
+	CBlobResult result;	
+
+	// Pre-filtering
+	// Surface > 1/450th image surface (see BlobBounds), and not in contact with sides of image.
+	// Only these components get turned into blobs with an edge list.
+	CBlobResult blobs;
+	components.GetBlobs( blobs, _bounds.minPixels(size), false );
+
+	// Accept or reject the blobs based on statistical features, computed once per blob.
+	vector<CBlobFeatures> features;
+	vector<bool> accepted;
+	blobs.GetFeatures(features);
+	classifyFeatures(features, accepted);
 
+	for (int i = 0; i < blobs.GetNumBlobs(); ++i )
+	{
+		CBlob* currentBlob = blobs.GetBlob(i);
+		if (accepted[i])
+			result.AddBlob(currentBlob);
+		// make rejected blobs black.
+		else if (img)
+			currentBlob->FillBlob(img,CV_RGB(0,0,0));
 	}
 	
 	// Compare with labeled known-correct.
 	int fp=0, fn=0, multdetect = 0;
-	bool success = checkLabeledBlobs(result,size,file,fp,fn,multdetect);//,&correct,&incorrect);
+	bool success;
+	if (ctx._labels)
+	{
+		success = ctx._labels->mask != NULL;
+		if (success)
+			checkLabeledBlobs(result,size,ctx._labels->mask,fp,fn,multdetect);
+	}
+	else
+		success = checkLabeledBlobs(result,size,file,fp,fn,multdetect);//,&correct,&incorrect);
 	//for (int i = 0; i < correct.GetNumBlobs(); ++i )
 	//	fillConvexHull(img,correct.GetBlob(i),CV_RGB(0,255,0));
 	//for (int i = 0; i < incorrect.GetNumBlobs(); ++i )
@@ -133,12 +222,12 @@ CBlobResult SignFinder::classifyBlobs(CBlobResult& blobs, char* file, CvSize siz
 	if (success)
 	{
 		if (_showPerformance) fprintf(stderr,"For this image, we encountered %d false positives, %d undetected signs, and %d multiple detections\n",fp,fn,multdetect);
-		_detperf._imagesChecked++;
-		_detperf._fp += fp;
-		_detperf._fn += fn;
-		_detperf._multDetect += multdetect;
+		ctx._detperf._imagesChecked++;
+		ctx._detperf._fp += fp;
+		ctx._detperf._fn += fn;
+		ctx._detperf._multDetect += multdetect;
 		if (fp || fn || multdetect)
-			_detperf._imagesErr++;
+			ctx._detperf._imagesErr++;
 	}	
 
 
@@ -149,35 +238,36 @@ CBlobResult SignFinder::classifyBlobs(CBlobResult& blobs, char* file, CvSize siz
  * Generate SURF keypoints over image, and compare them with a trained
  * database of surf keypoints. Disabled by default.
  */
-void SignFinder::processSurf(IplImage* img)
+void SignFinder::processSurf(Context& ctx, IplImage* vis) const
 {
-	// Detect SURF points in image.
+	// Detect SURF points in the integral image of the frame.
 	IpVec ipts;
-	surfDetDes(img,ipts,false,4,4,2,0.00005);
+	surfDetDesIntegral(ctx._frame.integral(),ipts,false,4,4,2,0.00005);
 	
 	// Match surf points against trained sign database.
+	// getMatches only writes to the first vector, the database is not modified.
 	IpPairVec match;
-	getMatches(ipts,_surfpoints,match);
+	getMatches(ipts,const_cast<IpVec&>(_surfpoints),match);
 
 	// draw matches on the image.
 	for (unsigned int i=0; i<match.size(); ++i)
-		drawPoint(img,match[i].first);
+		drawPoint(vis,match[i].first);
 	
 }
 
 /* readSign support functions */
 
 /**
- * Resize the image if necessary, and handle lifetime transparantly
+ * Resize the image if necessary. The given image stays with the caller;
+ * a resized image lives in the scratch space of the context, and must not be released.
  */
-IplImage* SignFinder::resize(IplImage* _img)
+IplImage* SignFinder::resize(Context& ctx, IplImage* _img) const
 {
 	IplImage* img;
 	if ((XRES) && ((XRES != cvGetSize(_img).width) || (YRES != cvGetSize(_img).height)))
         {
-                img = cvCreateImage(cvSize(XRES,YRES),IPL_DEPTH_8U,3);
+                img = ctx.scratch(ctx._resized,cvSize(XRES,YRES),IPL_DEPTH_8U,3);
                 cvResize(_img,img);
-                cvReleaseImage(&_img);
         }
         else
                 img = _img;
@@ -188,15 +278,13 @@ IplImage* SignFinder::resize(IplImage* _img)
 /** 
  * Perform per-pixel histogram matching.
  * matched with histogram that's trained on street-signs.
- * @return binary mask, white for the pixels that matched.
+ * @return binary mask, white for the pixels that matched. Owned by the context.
  */
-IplImage* SignFinder::histMatch(IplImage* img, IplImage* vis)
+IplImage* SignFinder::histMatch(Context& ctx, IplImage* img, IplImage* vis) const
 {
-	// Perform histogram matching.
-	CvMat* imgMat = cvCreateMatHeader(img->height, img->width,CV_8UC3);
-        imgMat = cvGetMat(img,imgMat);
-        IplImage* histMatched = skinDetectBayes(imgMat,_posHist,_negHist,_histThreshold);
-	cvReleaseMatHeader(&imgMat);
+	// Perform histogram matching, through the table compiled in loadHistograms.
+	IplImage* histMatched = ctx.scratch(ctx._histMatched,cvGetSize(img),IPL_DEPTH_8U,1);
+	_detector.detectInto(img,histMatched);
 
 	// Increase robustness for 'holes' in masks by dilating and eroding.
 	//cvDilate(histMatched,histMatched,NULL,1);
@@ -232,7 +320,7 @@ void colorBlobs(CBlobResult& blobs, IplImage* vis)
 /**
  * Draws a convex-hull around the blob
  */
-void SignFinder::drawConvexHull(CBlob* blob, IplImage* img, int i)
+void SignFinder::drawConvexHull(CBlob* blob, IplImage* img, int i) const
 {
 	// get the convex hull
 	CvSeq* hull;
@@ -260,45 +348,60 @@ void SignFinder::drawConvexHull(CBlob* blob, IplImage* img, int i)
  * - cutting out the street sign.
  * - adding the cut-out streetsign to the bottom of the result image
  * - performing OCR over the streetsign.
+ * The corners and text of the sign are added to signs, if given.
  */
-string SignFinder::processBlob(CBlob* currentBlob, char* file,  IplImage* result, int& prevY, IplImage* histMatchVis)
+string SignFinder::processBlob(Context& ctx, CBlob* currentBlob, char* file,  IplImage* result, int& prevY, IplImage* histMatchVis, vector<Sign>* signs) const
 {
 		// calculate some needed statistics over the blob
 		CBlobGetMajorAxisLength ma;
 		double height = ma(currentBlob);
 
-		// Find the corners with a distance-threshold between corners of 0.75* the height.
+		// Find the corners with a distance-threshold between corners of 0.75* the height,
+		// or fit them to the convex hull.
 		int numcorners = 4;
 		CvPoint corners[numcorners];
-		int foundcorners = findCorners(*currentBlob,corners,numcorners,height*0.75);
+		int foundcorners;
+		if (_cornerEngine == CORNERS_QUADFIT)
+			foundcorners = fitQuadrilateral(*currentBlob,corners,numcorners);
+		else
+			foundcorners = findCorners(*currentBlob,corners,numcorners,height*0.75,&ctx._corners);
 
 		// Ignore blobs where we didn't find four corners. These break code further on,
 		// and are not real signs nine out of ten times anyway.
 		if (foundcorners != numcorners)
 			return "";
 
-		// Cut the image out with perspective correction.
-		IplImage* cut = cutSign(result, corners, 4, true );
+		// Cut the image out with perspective correction, from the frame, so drawing the results doesn't change what's read.
+		IplImage* cut = cutSign(ctx._frame.frame(), corners, 4, false);
 
 		// OCR sign, and generate performance metrics.
-		string text = extractText(cut,_posHist, _negHist);	
+		string text = extractText(cut,ctx.ocr());	
 		if (_debug)
 			cerr << "---------------- Reading streetsign: " << text << endl;
-		int distance = compareText(text,file);
+		int distance;
+		if (ctx._labels)
+		{
+			istringstream labels(ctx._labels->text);
+			distance = compareText(text,labels);
+		}
+		else
+			distance = compareText(text,file);
 		if (distance != 1000)
 		{
 			if (_showPerformance)
-				cout << "OCR distance to truth: " << distance << endl;
-			_ocrperf._signsChecked++;
+				*ctx._log << "OCR distance to truth: " << distance << endl;
+			ctx._ocrperf._signsChecked++;
 			if (distance == 0)
-				_ocrperf._OCRcorrect++;
+				ctx._ocrperf._OCRcorrect++;
 			else
-				_ocrperf._editDist += distance;
+				ctx._ocrperf._editDist += distance;
 		}
 	
-		// Add the sign to the bottom of the image.
+		// Draw yellow circles around the corners, and add the sign to the bottom of the image.
 		if (result)
 		{
+			for (int i=0; i<numcorners; ++i)
+				cvCircle(result, corners[i],5,CV_RGB(255,255,0),2);
 			prevY -= cut->height;		
 			cvSetImageROI(result,cvRect(0,prevY,cut->width,cut->height));
 			cvCopy(cut,result);
@@ -308,6 +411,14 @@ string SignFinder::processBlob(CBlob* currentBlob, char* file,  IplImage* result
 			drawText(result,corners[1].x + 10, corners[1].y, text);
 		}
 		cvReleaseImage(&cut);
+
+		if (signs)
+		{
+			Sign sign;
+			memcpy(sign.corners, corners, sizeof(sign.corners));
+			sign.text = text;
+			signs->push_back(sign);
+		}
 	
 		return text;
 }
@@ -315,40 +426,121 @@ string SignFinder::processBlob(CBlob* currentBlob, char* file,  IplImage* result
 /**
  * Accepts an image containing one of more streetsigns. 
  * Tries to segment and read (OCR) this streetsign.
- * This is the entry-funtion on the class.
+ * Uses the context of the SignFinder itself, see readSigns(Context&, ...) for multi-threaded use.
  * @return newline-separated list of text on streetsigns.
  */
 string SignFinder::readSigns(char* file, IplImage* result)
 {
-	// Load image file.
-	IplImage* img = cvLoadImage(file);
-        if (!img)
+	return readSigns(_context, file, result);
+}
+
+/**
+ * Accepts an image containing one of more streetsigns. 
+ * Tries to segment and read (OCR) this streetsign.
+ * This is the entry-funtion on the class. It only modifies the given context, so
+ * concurrent calls are safe as long as every thread has its own context.
+ * @return newline-separated list of text on streetsigns.
+ */
+string SignFinder::readSigns(Context& ctx, char* file, IplImage* result) const
+{
+	// Load image file, decoded at no more than the resolution it is resized to.
+	IplImage* loaded = loadImage(file, cvSize(XRES, YRES));
+	string resultText = readImage(ctx, file, loaded, result);
+	cvReleaseImage(&loaded);
+	return resultText;
+}
+
+/**
+ * Reads the streetsigns in an image that has already been loaded, for instance by a Prefetcher.
+ * The image stays with the caller. file is used for the names of the output files and the labels.
+ * @param signs if given, receives the corners and text of every street sign.
+ * @return newline-separated list of text on streetsigns.
+ */
+string SignFinder::readImage(Context& ctx, char* file, IplImage* loaded, IplImage* result, vector<Sign>* signs) const
+{
+        if (!loaded)
         {
                 cerr << "Could not load file " << file << endl;
                 exit(1);
         }
-	if (_debug) cerr << "Processing " << file << endl;
 
 	// Resize master if requested.
-	img = resize(img);	
+	IplImage* img = resize(ctx, loaded);	
 
 	// Create copy of original image that algorithms can use to draw their results on.
-	bool wantsresult = true;
 	if (!result)
+		result = ctx.scratch(ctx._result,cvSize(img->width,img->height),IPL_DEPTH_8U,3);
+	cvCopy(img,result);
+
+	return readFrame(ctx, file, img, result, signs);
+}
+
+/**
+ * Reads the streetsigns in a frame of BGR pixels in memory, of the given width, height and bytes per row (stride).
+ * A frame of the resolution set with setRes (or any frame, after disableResize) is processed in place, and not copied.
+ * Any other frame is resized into scratch images of the context first, as readImage does.
+ * Nothing is read from or written to files; labels are only used if they are set on the context.
+ * @param signs receives the corners, in the coordinates of the frame of the caller, and the text of every street sign.
+ * @param vis if given, receives a copy of the frame at the resolution set with setRes, with the results drawn on it.
+ * It must be of that size, 8 bit, 3 channels.
+ * @return STATUS_OK, or the reason why the frame could not be read.
+ */
+SignFinder::Status SignFinder::readSigns(Context& ctx, const unsigned char* bgr, int width, int height, int stride, vector<Sign>& signs, IplImage* vis) const
+{
+	signs.clear();
+	if (!bgr || width <= 0 || height <= 0 || stride < width * 3)
+		return STATUS_INVALID_BUFFER;
+
+	// An image header around the pixels of the caller.
+	IplImage frame;
+	cvInitImageHeader(&frame, cvSize(width, height), IPL_DEPTH_8U, 3);
+	cvSetData(&frame, (void*) bgr, stride);
+	IplImage* img = resize(ctx, &frame);
+
+	if (vis)
 	{
-		result = cvCreateImage(cvSize(img->width,img->height),IPL_DEPTH_8U,3);
-		wantsresult = false;
+		if (vis->width != img->width || vis->height != img->height || vis->depth != IPL_DEPTH_8U || vis->nChannels != 3)
+			return STATUS_INVALID_VIS;
+		cvCopy(img, vis);
 	}
-	cvCopy(img,result);
+
+	// Without a file, there are no labels to read, unless the caller has set them.
+	ImageLabels none;
+	const ImageLabels* labels = ctx._labels;
+	if (!labels)
+		ctx._labels = &none;
+	readFrame(ctx, NULL, img, vis, &signs);
+	ctx._labels = labels;
+
+	// Corners of the resized frame back to the frame of the caller.
+	if (img != &frame)
+		for (unsigned int i = 0; i < signs.size(); ++i)
+			for (int j = 0; j < 4; ++j)
+			{
+				CvPoint& p = signs[i].corners[j];
+				p = cvPoint(cvRound(p.x * (double) width / img->width), cvRound(p.y * (double) height / img->height));
+			}
+	return STATUS_OK;
+}
+
+/**
+ * The work of readImage and readSigns on a frame that is already at its working resolution.
+ * @param file the name of the image, or NULL when it has none. Then ctx must have labels.
+ * @param result if given, the frame is cut from this image, and the results are drawn on it.
+ */
+string SignFinder::readFrame(Context& ctx, char* file, IplImage* img, IplImage* result, vector<Sign>* signs) const
+{
+	if (_debug && file) cerr << "Processing " << file << endl;
+	ctx._frame.setFrame(img);
 
 		// return mask of pixels that are blue.
 	IplImage* histMatchVis = NULL;
 	if (_debug)
 		histMatchVis = cvCreateImage(cvSize(img->width,img->height),IPL_DEPTH_8U,3);
-	IplImage* histMatched = histMatch(img,histMatchVis);
+	IplImage* histMatched = histMatch(ctx,img,histMatchVis);
 
 	// Save histogram-matching visualization if requested.
-	if (histMatchVis)
+	if (histMatchVis && file)
 	{
 		string matchedfile(file);
         	cvSaveImage((matchedfile+"_matched.jpg").c_str(),histMatchVis);
@@ -357,13 +549,14 @@ string SignFinder::readSigns(char* file, IplImage* result)
 
 	// Perform SURF feature-point detection for features that were detected in the trainset.
 	#ifdef SURF
-	processSurf(result);
+	if (result)
+		processSurf(ctx, result);
 	#endif	
 
 	// Perform blob detection on the histogram matched result, and accept or reject them based on 
 	// statistics.
-	CBlobResult blobs = CBlobResult( histMatched, NULL, 0, false );
-	blobs = classifyBlobs(blobs, file, cvSize(img->width, img->height), histMatchVis);
+	ctx._labeller.Label(histMatched);
+	CBlobResult blobs = classifyBlobs(ctx, ctx._labeller, file, cvSize(img->width, img->height), histMatchVis);
 	if (_debug)
 		cerr << "Classification: I think there are " << blobs.GetNumBlobs()  << " blue signs in this image" << endl << endl;
 	
@@ -381,7 +574,7 @@ string SignFinder::readSigns(char* file, IplImage* result)
 	{
 		// process the blob / found streetsign.
 		currentBlob = blobs.GetBlob(i);
-		string text = processBlob(currentBlob, file, result, prevY, histMatchVis); 		
+		string text = processBlob(ctx, currentBlob, file, result, prevY, histMatchVis, signs); 		
 		resultText += text + "\n";
 
 		// Draw a convex hull around found street-signs.
@@ -389,21 +582,53 @@ string SignFinder::readSigns(char* file, IplImage* result)
                         drawConvexHull(currentBlob,result,i);
 	}
 
-	// Cleanup
-	cvReleaseImage(&img);
-	cvReleaseImage(&histMatched);
+	// Cleanup, the scratch images stay with the context.
 	if (histMatchVis)
 		cvReleaseImage(&histMatchVis);
-	if (!wantsresult)
-		cvReleaseImage(&result);
 
 	return resultText;
 }
+
 /**
- * Load the color histograms, required for histogram matching
+ * Runs the detection part of readSigns, without classification and OCR: the histogram-matched blobs
+ * that cover at least minArea of the image and don't touch its sides, as input for tuning the blob classifier.
+ * @param size receives the size of the image the blobs were found in.
+ * @return false if the image could not be loaded.
+ */
+bool SignFinder::findCandidates(Context& ctx, char* file, double minArea, CBlobResult& candidates, CvSize& size) const
+{
+	IplImage* loaded = loadImage(file, cvSize(XRES, YRES));
+	if (!loaded)
+		return false;
+	IplImage* img = resize(ctx, loaded);
+	ctx._frame.setFrame(img);
+	size = cvGetSize(img);
+
+	IplImage* histMatched = histMatch(ctx,img);
+
+	BlobBounds bounds;
+	bounds._minArea = minArea;
+	ctx._labeller.Label(histMatched);
+	ctx._labeller.GetBlobs(candidates, bounds.minPixels(size), false);
+
+	cvReleaseImage(&loaded);
+	return true;
+}
+/**
+ * Load the color histograms, required for histogram matching.
+ * The binary hist.model is mapped if it's there, otherwise posHist.hist and negHist.hist are parsed.
  */
 void SignFinder::loadHistograms()
 {
+	if (_model.open("hist.model"))
+	{
+		_posHist = _model.posHist();
+		_negHist = _model.negHist();
+		_detector.compile(_posHist, _negHist, _histThreshold, _model.colorCode());
+		cerr << "Loaded histograms from hist.model" << endl;
+		return;
+	}
+
 	_posHist = loadHistogram("posHist.hist");
         _negHist = loadHistogram("negHist.hist");
         if (!(_posHist && _negHist))
@@ -411,6 +636,111 @@ void SignFinder::loadHistograms()
                 cerr << "ERROR: posHist.hist and/or negHist.hist histogram failed to load." << endl;
                 exit(1);
         }
+	_detector.compile(_posHist, _negHist, _histThreshold);
+	cerr << "Loaded histograms from posHist.hist and negHist.hist" << endl;
+}
+
+/**
+ * Detect with the histograms (see loadHistograms) instead of a detector model bundle that init loaded,
+ * at the default threshold, blob bounds and resolution. Used to compile a new bundle from retrained histograms.
+ */
+void SignFinder::useHistograms()
+{
+	_histThreshold = HISTTHRESHOLD;
+	_bounds = BlobBounds();
+	setRes(DEFAULT_XRES, DEFAULT_YRES);
+	if (_posHist)
+		_detector.setThreshold(_histThreshold);
+	else
+		loadHistograms();
+}
+
+#define DETECTOR_MODEL_VERSION 1
+
+/**
+ * Header of a detector model bundle, followed by the tables of the compiled BayesDetector.
+ */
+struct DetectorModelHeader
+{
+	char magic[4];			// "SFDM"
+	unsigned int version;		// DETECTOR_MODEL_VERSION
+	int xres, yres;
+	double histThreshold;
+	double minArea, minSquareness, minXYratio, minWHratio;
+	unsigned int tablesSize;
+	unsigned int checksum;		// FNV-1a over the tables
+};
+
+static const char DETECTOR_MODEL_MAGIC[4] = {'S', 'F', 'D', 'M'};
+
+/**
+ * Save everything the detection depends on in one file: the compiled decision table of the
+ * histogram matcher (for the current threshold and color code), the blob classifier bounds and
+ * the processing resolution. See loadModel.
+ */
+bool SignFinder::saveModel(const char* filename) const
+{
+	vector<char> tables;
+	_detector.saveTables(tables);
+
+	DetectorModelHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DETECTOR_MODEL_MAGIC, sizeof(header.magic));
+	header.version = DETECTOR_MODEL_VERSION;
+	header.xres = XRES;
+	header.yres = YRES;
+	header.histThreshold = _histThreshold;
+	header.minArea = _bounds._minArea;
+	header.minSquareness = _bounds._minSquareness;
+	header.minXYratio = _bounds._minXYratio;
+	header.minWHratio = _bounds._minWHratio;
+	header.tablesSize = tables.size();
+	header.checksum = HistogramModel::checksum(&tables[0], tables.size());
+
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+		return false;
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(&tables[0], 1, tables.size(), f) == tables.size();
+	return (fclose(f) == 0) && ok;
+}
+
+/**
+ * Load a detector model bundle written by saveModel. The decision table is used as it is,
+ * so the histograms are not loaded, and nothing is rebuilt.
+ * @return false if there's no such file, or it's not a valid model of this version.
+ */
+bool SignFinder::loadModel(const char* filename)
+{
+	FILE* f = fopen(filename, "rb");
+	if (!f)
+		return false;
+	DetectorModelHeader header;
+	vector<char> tables;
+	bool ok = fread(&header, sizeof(header), 1, f) == 1
+		&& !memcmp(header.magic, DETECTOR_MODEL_MAGIC, sizeof(header.magic)) && header.version == DETECTOR_MODEL_VERSION
+		&& header.tablesSize > 0 && header.tablesSize < (1 << 24);
+	if (ok)
+	{
+		tables.resize(header.tablesSize);
+		ok = fread(&tables[0], 1, tables.size(), f) == tables.size() && fgetc(f) == EOF
+			&& HistogramModel::checksum(&tables[0], tables.size()) == header.checksum
+			&& _detector.loadTables(&tables[0], tables.size());
+	}
+	fclose(f);
+	if (!ok)
+	{
+		cerr << "ERROR: " << filename << " is not a valid detector model (version " << DETECTOR_MODEL_VERSION << ")." << endl;
+		return false;
+	}
+
+	XRES = header.xres;
+	YRES = header.yres;
+	_histThreshold = header.histThreshold;
+	_bounds._minArea = header.minArea;
+	_bounds._minSquareness = header.minSquareness;
+	_bounds._minXYratio = header.minXYratio;
+	_bounds._minWHratio = header.minWHratio;
+	return true;
 }
 
 /**
@@ -427,12 +757,19 @@ void SignFinder::loadSurf()
  */
 void SignFinder::init()
 {
-	_histThreshold = 0.19;
-	XRES = 1600; YRES = 1200;
+	_histThreshold = HISTTHRESHOLD;
+	XRES = DEFAULT_XRES; YRES = DEFAULT_YRES;
 	_debug = false;
 	_showPerformance = true;
+	_cornerEngine = CORNERS_FEATURES;
+	_posHist = NULL;
+	_negHist = NULL;
 
-	loadHistograms();
+	// A detector model bundle replaces the histograms and the settings above.
+	if (loadModel("detector.model"))
+		cerr << "Loaded detector model detector.model, the histograms are not read" << endl;
+	else
+		loadHistograms();
 	#ifdef SURF
 	loadSurf();
 	#endif	
@@ -441,10 +778,21 @@ void SignFinder::init()
 /**
  * If there are truth-grounded 'labels' available (<file>_mask.png for sign-detection and <file>.txt for OCR),
  * the software collects performance metrics. This function prints the aggregated performance metrics
- * to the screen.
+ * of the own context, including all contexts merged into it, to the screen.
  */
-void SignFinder::performanceMeasurements()
+void SignFinder::performanceMeasurements() const
 {
+	performanceMeasurements(_context);
+}
+
+/**
+ * Prints the aggregated performance metrics of the given context to the screen.
+ */
+void SignFinder::performanceMeasurements(const Context& ctx) const
+{
+	const DetectPerformance& _detperf = ctx._detperf;
+	const OcrPerformance& _ocrperf = ctx._ocrperf;
+
 	if (_detperf._imagesChecked)
 	{
 		printf("\n------------ Sign Detection performance:\n");
@@ -464,8 +812,13 @@ void SignFinder::performanceMeasurements()
  */
 void SignFinder::cleanup()
 {
-	cvReleaseHist(&_posHist);
-	cvReleaseHist(&_negHist);
+	// Histograms of the model are owned by the model, with a detector model bundle there are none.
+	if (!_model.isOpen() && _posHist && _negHist)
+	{
+		cvReleaseHist(&_posHist);
+		cvReleaseHist(&_negHist);
+	}
+	_model.close();
 	_posHist = NULL;
 	_negHist = NULL;
 
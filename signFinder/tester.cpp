@@ -34,12 +34,24 @@
  */
 
 
+
 #include <iostream>
 #include <fstream>
-#include <deque>
+#include <sstream>
 #include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
 #include "lib/histogramtool/histogramTool.h"
+#include "lib/histogramtool/bayesDetector.h"
+#include "lib/histogramtool/histogramModel.h"
 #include "modules/TestHandler.h"
+#include "modules/WorkQueue.h"
+#include "modules/Prefetcher.h"
 //#include "lib/bloblib/Blob.h"
 //#include "lib/bloblib/BlobResult.h"
 
@@ -55,79 +67,488 @@ const double exponent = 1.1;
 
 const int WINDOWX = 1600;
 const int WINDOWY = 1200;
+// Measure at the resolution of the images, or resize them to XRES x YRES, as signFinder does.
+//const int XRES = 1600;
+//const int YRES = 1200;
+const int XRES = 0;
+const int YRES = 0;
 
-int _curFile=0;
+// Checkpoint shards are named RocCurve.ckpt.0, RocCurve.ckpt.1, ...
+const char* CHECKPOINT = "RocCurve.ckpt";
+const unsigned int CHECKPOINT_MAGIC = 0x31434f52; // "ROC1"
+const unsigned int CHECKPOINT_HEADER = 0x48434f52; // "ROCH"
 
 CvHistogram* _posHist;
 CvHistogram* _negHist;
+HistogramModel _model;
+BayesDetector _detector;
 
-struct RocColItem {
-	deque<double> tp;
-	deque<double> fp;
-};
+/**
+ * The RoC-measurements of one file: tp and fp at each threshold.
+ */
+struct RocFile
+{
+	string file;
+	vector<double> thr;
+	vector<double> tp;
+	vector<double> fp;
 
-typedef map<double,RocColItem> RocMap;
-RocMap rocmap;
+	void add(double threshold, double truePos, double falsePos)
+	{
+		thr.push_back(threshold);
+		tp.push_back(truePos);
+		fp.push_back(falsePos);
+	}
+};
 
-void processFile(char* file)
+/**
+ * Running mean and standard deviation (Welford's method), so the curve
+ * can be aggregated without keeping every sample.
+ */
+struct RunningStat
 {
-	// See if we can find a mask for this file.
-        string maskfile(file);
-        IplImage* label = cvLoadImage((maskfile+"_mask.png").c_str());
-	// We can't test performance is there's no known correct mask.
-	if (!label)
+	RunningStat() : n(0), mean(0), m2(0) {}
+
+	void add(double x)
 	{
-		cerr << "No mask for file " << file << " skipping..\n";
-		return;	
+		++n;
+		double delta = x - mean;
+		mean += delta / n;
+		m2 += delta * (x - mean);
 	}
 
-	IplImage* img;
-	img = cvLoadImage(file);
-        if (!img)
-        {
-                cerr << "Could not load file " << file << endl;
-                exit(1);
-        }
-	cout << "Processing " << file << endl;
-	// return mask of images that have been detected.
-	CvMat* imgMat = cvCreateMatHeader(img->height, img->width,CV_8UC3);
-	imgMat = cvGetMat(img,imgMat);
+	double sd() const {return n ? sqrt(m2 / n) : 0;}
+
+	long n;
+	double mean, m2;
+};
+
+struct RocColItem {
+	RunningStat tp;
+	RunningStat fp;
+};
 
-	IplImage* histMatched, result;
+typedef map<double,RocColItem> RocMap;
+
+/**
+ * Measures tp and fp at every threshold by matching the image once per threshold.
+ * img and label are the loaded file and its <file>_mask.png.
+ */
+void processFile(IplImage* img, IplImage* label, BayesDetector& detector, RocFile& roc)
+{
+	double threshold = HISTTHRESHOLD;
 #ifdef ROC
 	double minStep = (maxThr - minThr) / pow(exponent,measurements);
-	for (HISTTHRESHOLD=minThr; HISTTHRESHOLD<maxThr; HISTTHRESHOLD += minStep )
+	for (threshold=minThr; threshold<maxThr; threshold += minStep )
 	{
 		minStep *= exponent;
 #endif
-		IplImage* histMatched = skinDetectBayes(imgMat,_posHist,_negHist,HISTTHRESHOLD); 
+		// return mask of images that have been detected.
+		detector.setThreshold(threshold);
+		IplImage* histMatched = detector.detect(img);
 		IplImage* result = cvCreateImage(cvGetSize(histMatched), IPL_DEPTH_8U, 3);
 		cvCvtColor(histMatched, result, CV_GRAY2RGB);
 
 		// Compare results with known-correct mask.
 		double fp;
 		double tp = compareMasks(result,label,&fp);
-		printf("**** file: %s,thr: %f, tp: %f, fp: %f\n",file,HISTTHRESHOLD, tp,fp);
-		// Add the results to the ROC-curve.
-		//rocmap[HISTTHRESHOLD].threshold = HISTTHRESHOLD;
-		rocmap[HISTTHRESHOLD].tp.push_back(tp);
-		rocmap[HISTTHRESHOLD].fp.push_back(fp);
+		roc.add(threshold, tp, fp);
 
 	cvReleaseImage(&histMatched);
 	cvReleaseImage(&result);
 #ifdef ROC
 	}
 #endif
+}
+
+/** Orders histogram bins on their skin/non-skin ratio. */
+struct BinRatioLess
+{
+	BinRatioLess(const BayesDetector& detector) : _d(detector) {}
+	bool operator()(int a, int b) const {return _d.binRatio(a) < _d.binRatio(b);}
+	const BayesDetector& _d;
+};
+
+/**
+ * Measures the same RoC-points as processFile, in a single pass over the image.
+ * Every pixel is looked up once in the histograms, and the pixels are counted per histogram bin,
+ * together with the sum of their label values. A pixel is positive at threshold t exactly when the
+ * ratio of its bin is >= t, so with the bins sorted on ratio, the detected surface and the true-positive
+ * surface at any threshold are suffix sums. The sums are integers, so tp and fp come out exactly
+ * as compareMasks computes them on the thresholded mask.
+ */
+void processFileSinglePass(IplImage* img, IplImage* label, const BayesDetector& detector, RocFile& roc)
+{
+	// Resize label to the image size, as compareMasks does.
+	IplImage* compLabel = NULL;
+	if (( img->width != label->width ) || ( img->height != label->height ))
+	{
+		compLabel = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, 3);
+		cvResize(label,compLabel);
+		label = compLabel;
+	}
+
+	// Count pixels and label values per bin. compareMasks only looks at the first channel.
+	const int numBins = detector.numBins();
+	vector<long long> binPixels(numBins, 0), binLabel(numBins, 0);
+	long long labelTotal = 0;
+	IplImage* bins = cvCreateImage(cvGetSize(img), IPL_DEPTH_32S, 1);
+	detector.binsInto(img, bins);
+	for (int y = 0; y < img->height; ++y)
+	{
+		const int* b = (const int*)(bins->imageData + y * bins->widthStep);
+		const uchar* l = (const uchar*)(label->imageData + y * label->widthStep);
+		for (int x = 0; x < img->width; ++x, l += 3)
+		{
+			binPixels[b[x]]++;
+			binLabel[b[x]] += l[0];
+			labelTotal += l[0];
+		}
+	}
 
+	// Sort the bins on ratio; 0/0 bins are never positive. Suffix sums give the totals above a threshold.
+	vector<int> order;
+	for (int i = 0; i < numBins; ++i)
+		if (binPixels[i] && !isnan(detector.binRatio(i)))
+			order.push_back(i);
+	sort(order.begin(), order.end(), BinRatioLess(detector));
+	vector<float> ratios(order.size());
+	vector<long long> pixelsAbove(order.size() + 1, 0), labelAbove(order.size() + 1, 0);
+	for (int k = (int) order.size() - 1; k >= 0; --k)
+	{
+		ratios[k] = detector.binRatio(order[k]);
+		pixelsAbove[k] = pixelsAbove[k+1] + binPixels[order[k]];
+		labelAbove[k] = labelAbove[k+1] + binLabel[order[k]];
+	}
+
+	double labelSurface = labelTotal / 255.;
+	double minStep = (maxThr - minThr) / pow(exponent,measurements);
+	for (double threshold=minThr; threshold<maxThr; threshold += minStep )
+	{
+		minStep *= exponent;
+
+		// The detector compares against the threshold as a float.
+		int k = lower_bound(ratios.begin(), ratios.end(), (float) threshold) - ratios.begin();
+		double estimationSurface = (double) pixelsAbove[k];
+		double tpSurface = labelAbove[k] / 255.;
+		double tp = tpSurface / labelSurface; 
+		double fp = (estimationSurface - tpSurface) / (label->width * label->height);
+		roc.add(threshold, tp, fp);
+	}
 
 	// Cleanup
+	cvReleaseImage(&bins);
+	if (compLabel)
+		cvReleaseImage(&compLabel);
+}
+
+/**
+ * Checkpoint
+ *
+ * Every measured file is appended as one record to a checkpoint shard, and the shard is flushed
+ * after every record. A killed run therefore loses at most the record that was being written,
+ * and a restarted run skips the files that are already in one of the shards. Every run appends
+ * to a shard of its own, so the shards of runs on different machines can simply be copied together.
+ *
+ * A shard starts with a header: magic and the fingerprint of the run (see fingerprint()). Shards
+ * of runs with another fingerprint, such as runs on histograms that were trained since, are skipped.
+ * Record: magic, name length, name, count, and count times (threshold, tp, fp) as doubles.
+ */
+string checkpointName(int shard)
+{
+	ostringstream name;
+	name << CHECKPOINT << "." << shard;
+	return name.str();
+}
+
+bool checkpointExists(int shard)
+{
+	return access(checkpointName(shard).c_str(), F_OK) == 0;
+}
+
+/**
+ * Everything the measurements of a file depend on: the bins of both histograms, the resolution,
+ * the thresholds, and whether they're measured per threshold (-s).
+ */
+unsigned int fingerprint(bool sweep)
+{
+	unsigned int hash = HistogramModel::checksum(NULL, 0);
+	CvHistogram* hists[] = {_posHist, _negHist};
+	for (int h = 0; h < 2; ++h)
+		for (int i = 0; i < hists[h]->mat.dim[0].size; ++i)
+			for (int j = 0; j < hists[h]->mat.dim[1].size; ++j)
+			{
+				float bin = cvQueryHistValue_2D(hists[h], i, j);
+				hash = HistogramModel::checksum(&bin, sizeof(bin), hash);
+			}
+	int colorCode = _model.isOpen() ? _model.colorCode() : 1;
+	int resolution[2] = {XRES, YRES};
+	double thresholds[3] = {minThr, maxThr, (maxThr - minThr) / pow(exponent,measurements)};
+	hash = HistogramModel::checksum(&colorCode, sizeof(colorCode), hash);
+	hash = HistogramModel::checksum(resolution, sizeof(resolution), hash);
+	hash = HistogramModel::checksum(thresholds, sizeof(thresholds), hash);
+	return HistogramModel::checksum(&sweep, sizeof(sweep), hash);
+}
+
+void writeHeader(FILE* f, unsigned int fingerprint)
+{
+	unsigned int header[2] = {CHECKPOINT_HEADER, fingerprint};
+	fwrite(header, sizeof(header), 1, f);
+	fflush(f);
+}
+
+void writeRecord(FILE* f, const RocFile& roc)
+{
+	unsigned int magic = CHECKPOINT_MAGIC;
+	unsigned int nameLen = roc.file.size();
+	unsigned int count = roc.thr.size();
+	fwrite(&magic, sizeof(magic), 1, f);
+	fwrite(&nameLen, sizeof(nameLen), 1, f);
+	fwrite(roc.file.data(), 1, nameLen, f);
+	fwrite(&count, sizeof(count), 1, f);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		double point[3] = {roc.thr[i], roc.tp[i], roc.fp[i]};
+		fwrite(point, sizeof(double), 3, f);
+	}
+	fflush(f);
+}
+
+/**
+ * Reads the next record of a shard.
+ * @return false at the end of the shard, or at a record that was cut short.
+ */
+bool readRecord(FILE* f, RocFile& roc)
+{
+	unsigned int magic, nameLen, count;
+	if (fread(&magic, sizeof(magic), 1, f) != 1 || magic != CHECKPOINT_MAGIC)
+		return false;
+	if (fread(&nameLen, sizeof(nameLen), 1, f) != 1 || nameLen > 4096)
+		return false;
+	roc.file.resize(nameLen);
+	if (nameLen && fread(&roc.file[0], 1, nameLen, f) != nameLen)
+		return false;
+	if (fread(&count, sizeof(count), 1, f) != 1 || count > 100000)
+		return false;
+	roc.thr.resize(count);
+	roc.tp.resize(count);
+	roc.fp.resize(count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		double point[3];
+		if (fread(point, sizeof(double), 3, f) != 3)
+			return false;
+		roc.thr[i] = point[0];
+		roc.tp[i] = point[1];
+		roc.fp[i] = point[2];
+	}
+	return true;
+}
+
+/**
+ * Streams all checkpoint shards of the given fingerprint. Every file counts once, also when it occurs in more than one shard.
+ * @param done receives the names of the measured files.
+ * @param rocmap if not NULL, receives the RoC-measurements.
+ * @param warn whether to warn about the shards that are skipped.
+ */
+void readCheckpoint(set<string>& done, RocMap* rocmap, unsigned int fingerprint, bool warn)
+{
+	for (int shard = 0; checkpointExists(shard); ++shard)
+	{
+		FILE* f = fopen(checkpointName(shard).c_str(), "rb");
+		if (!f)
+			continue;
+		unsigned int header[2];
+		if (fread(header, sizeof(header), 1, f) != 1 || header[0] != CHECKPOINT_HEADER || header[1] != fingerprint)
+		{
+			if (warn)
+				cerr << "WARNING: Skipping " << checkpointName(shard) << ", it was measured with other histograms or settings. Use -f to remove it." << endl;
+			fclose(f);
+			continue;
+		}
+		RocFile roc;
+		while (readRecord(f, roc))
+		{
+			if (!done.insert(roc.file).second)
+				continue;
+			if (rocmap)
+				for (unsigned int i = 0; i < roc.thr.size(); ++i)
+				{
+					(*rocmap)[roc.thr[i]].tp.add(roc.tp[i]);
+					(*rocmap)[roc.thr[i]].fp.add(roc.fp[i]);
+				}
+		}
+		fclose(f);
+	}
+}
+
+void removeCheckpoint()
+{
+	for (int shard = 0; checkpointExists(shard); ++shard)
+		unlink(checkpointName(shard).c_str());
+}
+
+/**
+ * The files to measure: those of the command line and the lists, except the ones that are already in the checkpoint.
+ */
+class ResumeSource : public FileSource
+{
+	public:
+		ResumeSource(char** files, int count, char separator, const set<string>& done)
+			: FileSource(files, count, separator), _done(done) {}
+
+		bool next(string& file)
+		{
+			while (FileSource::next(file))
+			{
+				if (!_done.count(file))
+					return true;
+				cout << "Already measured " << file << ", skipping.." << endl;
+			}
+			return false;
+		}
+
+	private:
+		const set<string>& _done;
+};
+
+/**
+ * Measures the files on a pool of threads. Every worker has its own copy of the detector,
+ * results are printed and checkpointed in the order of the command-line.
+ */
+class RocQueue : public WorkQueue
+{
+	public:
+		struct Job
+		{
+			string file;
+			Prefetcher::Item* item;
+			bool hasMask;
+			RocFile roc;
+		};
+
+		RocQueue(int threads, Prefetcher& prefetch, FILE* checkpoint, bool sweep)
+			: WorkQueue(threads), _prefetch(prefetch)
+		{
+			_checkpoint = checkpoint;
+			_sweep = sweep;
+			_detectors.resize(numThreads(), _detector);
+		}
+
+	protected:
+		void* produce()
+		{
+			Prefetcher::Item* item = _prefetch.next();
+			if (!item)
+				return NULL;
+			Job* job = new Job;
+			job->item = item;
+			job->file = item->file;
+			job->roc.file = job->file;
+			return job;
+		}
+
+		void process(void* j, int worker)
+		{
+			Job* job = (Job*) j;
+			_prefetch.fetch(job->item);
+			// We can't test performance is there's no known correct mask.
+			IplImage* label = job->item->labels.mask;
+			job->hasMask = label != NULL;
+			if (label && !job->item->image)
+			{
+				cerr << "Could not load file " << job->file << endl;
+				exit(1);
+			}
+			if (label && _sweep)
+				processFile(job->item->image, label, _detectors[worker], job->roc);
+			else if (label)
+				processFileSinglePass(job->item->image, label, _detectors[worker], job->roc);
+			_prefetch.release(job->item);
+		}
+
+		void consume(void* j)
+		{
+			Job* job = (Job*) j;
+			if (!job->hasMask)
+				cerr << "No mask for file " << job->file << " skipping..\n";
+			else
+			{
+				cout << "Processing " << job->file << endl;
+				for (unsigned int i = 0; i < job->roc.thr.size(); ++i)
+					printf("**** file: %s,thr: %f, tp: %f, fp: %f\n",job->file.c_str(),job->roc.thr[i],job->roc.tp[i],job->roc.fp[i]);
+				fflush(stdout);
+				writeRecord(_checkpoint, job->roc);
+			}
+			delete job;
+		}
+
+	private:
+		Prefetcher& _prefetch;
+		FILE* _checkpoint;
+		bool _sweep;
+		vector<BayesDetector> _detectors;
+};
+
+/**
+ * Check that every BayesDetector kernel this cpu supports produces exactly the mask of skinDetectBayes,
+ * at a range of thresholds. The ROC numbers depend on it.
+ * @return the number of pixels that differ.
+ */
+long verifyFile(char* file)
+{
+	IplImage* img = cvLoadImage(file);
+	if (!img)
+	{
+		cerr << "Could not load file " << file << endl;
+		exit(1);
+	}
+	CvMat* imgMat = cvCreateMatHeader(img->height, img->width,CV_8UC3);
+	imgMat = cvGetMat(img,imgMat);
+
+	// The reference in the color space the detector was compiled for.
+	int colorCode = _model.isOpen() ? _model.colorCode() : 1;
+	const double thresholds[] = {minThr, 0.05, HISTTHRESHOLD, 1, maxThr};
+	long mismatches = 0;
+	for (unsigned int t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); ++t)
+	{
+		IplImage* reference = skinDetectBayes(imgMat,_posHist,_negHist,thresholds[t],colorCode);
+		_detector.setThreshold(thresholds[t]);
+		for (int isa = 0; isa < BAYES_KERNEL_COUNT; ++isa)
+		{
+			if (!bayesKernelSupported(isa))
+				continue;
+			_detector.setKernel(isa);
+			IplImage* mask = _detector.detect(img);
+
+			long diff = 0;
+			for (int y = 0; y < img->height; ++y)
+			{
+				uchar* a = (uchar*)(reference->imageData + y * reference->widthStep);
+				uchar* b = (uchar*)(mask->imageData + y * mask->widthStep);
+				for (int x = 0; x < img->width; ++x)
+					diff += (a[x] != b[x]);
+			}
+			printf("**** file: %s, thr: %f, kernel: %s, differing pixels: %ld\n",file,thresholds[t],bayesKernelName(isa),diff);
+			mismatches += diff;
+			cvReleaseImage(&mask);
+		}
+		cvReleaseImage(&reference);
+	}
+	_detector.setKernel(bayesBestKernel());
+
 	cvReleaseMatHeader(&imgMat);
 	cvReleaseImage(&img);
-	cvReleaseImage(&label);
+	return mismatches;
 }
 
-void printResults()
+void printResults(unsigned int fingerprint)
 {
+	// Merge all checkpoint shards of this fingerprint, so files measured in earlier runs count too.
+	set<string> done;
+	RocMap rocmap;
+	readCheckpoint(done, &rocmap, fingerprint, false);
+
 	ofstream ofs("RocCurve.dat");
 	ofs << "# Histogram-matching RoC-curve based on the test-set." << endl;
 	ofs << "# threshold\ttp\tsd\tfp\tsd" << endl << endl;
@@ -140,29 +561,13 @@ void printResults()
         while (it != end)
 	{
 		double threshold = it->first;
-		RocColItem cur = it->second;
-
-		// calculate averages
-		double tpavg = 0;
-		double fpavg = 0;
-		for (int i=0; i<cur.tp.size(); ++i)
-		{
-			tpavg += cur.tp[i];
-			fpavg += cur.fp[i];
-		}
-		tpavg /= cur.tp.size();
-		fpavg /= cur.tp.size();
+		const RocColItem& cur = it->second;
 
-		// calculate standard deviation
-		double tpdev = 0;
-		double fpdev = 0;	
-		for (int i=0; i<cur.tp.size(); ++i)
-		{
-			tpdev += pow(cur.tp[i] - tpavg,2);
-			fpdev += pow(cur.fp[i] - fpavg,2);
-		}
-		tpdev = sqrt(tpdev / cur.tp.size());
-		fpdev = sqrt(fpdev / cur.fp.size());
+		// averages and standard deviation
+		double tpavg = cur.tp.mean;
+		double fpavg = cur.fp.mean;
+		double tpdev = cur.tp.sd();
+		double fpdev = cur.fp.sd();
 
 		// write results to file.
 		ofs << threshold << " \t " << tpavg << " \t " << tpdev << " \t " << fpavg << " \t " << fpdev << endl;
@@ -182,7 +587,7 @@ void printResults()
 	// calculate the surface under the last part of the curve towards tp=0 and fp=0
 	surface += prevFp * (0.5*prevTp);
 
-	cout << "Surface under RoC curve: " << surface << endl;	
+	cout << "Surface under RoC curve: " << surface << " (" << done.size() << " files)" << endl;	
 	ofs << endl << "# Surface under RoC curve: " << surface << endl;	
 
 	ofs.close();
@@ -190,6 +595,15 @@ void printResults()
 
 void init()
 {
+	// Prefer the binary model, see SignFinder::loadHistograms.
+	if (_model.open("hist.model"))
+	{
+		_posHist = _model.posHist();
+		_negHist = _model.negHist();
+		_detector.compile(_posHist, _negHist, HISTTHRESHOLD, _model.colorCode());
+		return;
+	}
+
 	_posHist = loadHistogram("posHist.hist");
         _negHist = loadHistogram("negHist.hist");
 	if (!(_posHist && _negHist))
@@ -197,12 +611,17 @@ void init()
 		cerr << "ERROR: posHist.hist and/or negHist.hist histogram failed to load." << endl;
 		exit(1);
 	}
+	_detector.compile(_posHist, _negHist, HISTTHRESHOLD);
 }
 
 void cleanup()
 {
-	cvReleaseHist(&_posHist);
-	cvReleaseHist(&_negHist);
+	if (!_model.isOpen())
+	{
+		cvReleaseHist(&_posHist);
+		cvReleaseHist(&_negHist);
+	}
+	_model.close();
 	_posHist = NULL;
 	_negHist = NULL;
 }
@@ -211,16 +630,117 @@ int main(int argc, char** argv)
 {
         if (argc < 2)
         {
-                cerr << "Usage: " << argv[0] << " <image-files>" << endl;
+                cerr << "Usage: " << argv[0] << " [-x] [-s] [-f] [-j threads] [-k depth] [-m megabytes] [-0] [--list file] <image-files | ->" << endl;
+                cerr << "  -x  verify the histogram-matching kernels against skinDetectBayes instead of measuring the RoC-curve" << endl;
+                cerr << "  -s  measure the RoC-curve by matching the image once per threshold (slow, same results)" << endl;
+                cerr << "  -f  start afresh: remove the checkpoint of earlier runs instead of resuming" << endl;
+                cerr << "  -j  number of threads to measure files on (default 1)" << endl;
+                cerr << "  -k  number of files to load ahead of the measurement, 0 to load them when needed (default 4)" << endl;
+                cerr << "  -m  megabytes of memory for files loaded ahead (default 256)" << endl;
+                cerr << "  --list  read the paths of the image-files from a file, - for stdin. A - among the image-files reads them from stdin as well" << endl;
+                cerr << "  -0  paths in lists are separated by NUL characters instead of newlines" << endl;
                 exit(0);
         }
 
+	// Parse command-line parameters
+	bool verify = false;
+	bool sweep = false;
+	bool fresh = false;
+	int c, threads = 1, depth = 4, budget = 256;
+	char separator = '\n';
+	const char* list = NULL;
+	static struct option longOptions[] = {{"list", required_argument, NULL, 'l'}, {NULL, 0, NULL, 0}};
+	while ((c = getopt_long (argc, argv, "xsfj:k:m:0", longOptions, NULL)) != -1)
+	{
+		switch(c)
+		{
+			case 'x':
+				verify = true;
+			break;
+			case 's':
+				sweep = true;
+			break;
+			case 'f':
+				fresh = true;
+			break;
+			case 'j':
+				threads = atoi(optarg);
+			break;
+			case 'k':
+				depth = atoi(optarg);
+			break;
+			case 'm':
+				budget = atoi(optarg);
+			break;
+			case '0':
+				separator = '\0';
+			break;
+			case 'l':
+				list = optarg;
+			break;
+		}
+	}
+
 	init();
 	// iterate through all files.
-	while (++_curFile < argc)
-        	processFile(argv[_curFile]);
+	if (verify)
+	{
+		long mismatches = 0;
+		FileSource files(argv + optind, argc - optind, separator);
+		if (list && !files.setList(list))
+		{
+			cerr << "ERROR: Could not open list " << list << endl;
+			exit(1);
+		}
+		string file;
+		while (files.next(file))
+			mismatches += verifyFile((char*) file.c_str());
+		cout << (mismatches ? "FAILED: " : "OK: ") << mismatches << " differing pixels" << endl;
+		cleanup();
+		return mismatches ? 1 : 0;
+	}
+
+	// Resume: skip the files that are already in the checkpoint of the same histograms and settings,
+	// and append to a new shard.
+	if (fresh)
+		removeCheckpoint();
+	unsigned int settings = fingerprint(sweep);
+	set<string> done;
+	readCheckpoint(done, NULL, settings, true);
+	int shard = 0;
+	while (checkpointExists(shard))
+		++shard;
+	FILE* checkpoint = fopen(checkpointName(shard).c_str(), "ab");
+	if (!checkpoint)
+	{
+		cerr << "ERROR: Could not open checkpoint " << checkpointName(shard) << endl;
+		exit(1);
+	}
+	writeHeader(checkpoint, settings);
+
+	ResumeSource files(argv + optind, argc - optind, separator, done);
+	if (list && !files.setList(list))
+	{
+		cerr << "ERROR: Could not open list " << list << endl;
+		exit(1);
+	}
+
+	// Load the files and their masks depth files ahead, within a budget of megabytes.
+	{
+		Prefetcher prefetch(files, depth, (size_t) budget << 20, MIN(depth, MAX(threads, 1)));
+		prefetch.setImageSize(cvSize(XRES,YRES), true);
+		prefetch.setMasks(cvSize(0,0), CV_LOAD_IMAGE_COLOR, true);
+		RocQueue queue(threads, prefetch, checkpoint, sweep);
+		queue.run();
+	}
+
+	// Don't leave a shard without records behind when there was nothing to do.
+	bool empty = ftell(checkpoint) == 2 * sizeof(unsigned int);
+	fclose(checkpoint);
+	if (empty)
+		unlink(checkpointName(shard).c_str());
 
-	printResults();
+	printResults(settings);
 	cleanup();
 
 	return 0;
@@ -36,12 +36,20 @@
 
 #include <iostream>
 #include <deque>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
 #include <opencv/highgui.h>
 #include "lib/histogramtool/histogramTool.h"
+#include "lib/histogramtool/histogramModel.h"
 #include "OpenSURF/surflib.h"
 #include "SignHandler.h"
 #include "CornerFinder.h"
 #include "modules/TestHandler.h"
+#include "modules/WorkQueue.h"
+#include "modules/Prefetcher.h"
 
 #define SHOWIMAGES
 #define DEBUG 
@@ -55,16 +63,97 @@ int binsize = 64;
 const int XRES = 0;
 const int YRES = 0;
 
-int _curFile=0;
+// Images are only shown when all work is done on the main thread.
+bool _show = true;
 
-CvHistogram* _posHist;
-CvHistogram* _negHist;
+/**
+ * Pixel counts per bin of the positive and negative color histograms.
+ * Counts are kept as integers, so that they stay exact when they are added up over
+ * a large set of images, on several threads or machines.
+ */
+struct BinCounts
+{
+	vector<unsigned long long> pos;
+	vector<unsigned long long> neg;
+
+	BinCounts() : pos(binsize * binsize, 0), neg(binsize * binsize, 0) {}
+
+	void add(const BinCounts& other)
+	{
+		for (unsigned int i = 0; i < pos.size(); ++i)
+		{
+			pos[i] += other.pos[i];
+			neg[i] += other.neg[i];
+		}
+	}
+};
+
+BinCounts _counts;
 IpVec _surfpoints;
 
+/**
+ * Writes counts to a file that loadHistogram can read. The bins are saved as doubles,
+ * which hold the counts exactly up to 2^53.
+ */
+void writeCounts(const vector<unsigned long long>& counts, const char* filename)
+{
+	int dims[] = {binsize, binsize};
+	CvMatND* bins = cvCreateMatND(2, dims, CV_64FC1);
+	for (int i = 0; i < binsize; ++i)
+		for (int j = 0; j < binsize; ++j)
+			cvSetReal2D(bins, i, j, (double) counts[i * binsize + j]);
+	cvSave(filename, bins, "hist", "Histogram saved by trainer.");
+	cvReleaseMatND(&bins);
+}
+
+/**
+ * Adds the counts in a histogram file (as written by writeCounts or writeHistogram) to counts.
+ * @return false if the file could not be loaded, or has an other number of bins.
+ */
+bool readCounts(vector<unsigned long long>& counts, const char* filename)
+{
+	CvMatND* bins = (CvMatND*) cvLoad(filename);
+	if (!bins)
+		return false;
+	bool ok = (bins->dims == 2) && (bins->dim[0].size == binsize) && (bins->dim[1].size == binsize);
+	if (ok)
+		for (int i = 0; i < binsize; ++i)
+			for (int j = 0; j < binsize; ++j)
+				counts[i * binsize + j] += (unsigned long long) (cvGetReal2D(bins, i, j) + 0.5);
+	cvReleaseMatND(&bins);
+	return ok;
+}
+
+/**
+ * A float histogram of counts, for the detector. Release with cvReleaseHist.
+ */
+CvHistogram* countsToHistogram(const vector<unsigned long long>& counts)
+{
+	int dims[] = {binsize, binsize};
+	CvHistogram* hist = cvCreateHist(2, dims, CV_HIST_ARRAY);
+	for (int i = 0; i < binsize; ++i)
+		for (int j = 0; j < binsize; ++j)
+			*cvGetHistValue_2D(hist, i, j) = (float) counts[i * binsize + j];
+	return hist;
+}
+
+/**
+ * Writes counts as a binary histogram model, see HistogramModel.
+ */
+bool writeModel(const BinCounts& counts, const char* filename)
+{
+	CvHistogram* pos = countsToHistogram(counts.pos);
+	CvHistogram* neg = countsToHistogram(counts.neg);
+	bool ok = HistogramModel::write(filename, pos, neg, 1);
+	cvReleaseHist(&pos);
+	cvReleaseHist(&neg);
+	return ok;
+}
+
 /*
  * Train the SURF keypoints in the masked part of an image
  */
-void processSingleSurf(IplImage* img, IplImage* mask)
+void processSingleSurf(IplImage* img, IplImage* mask, IpVec& surfpoints)
 {
 	// find corners of sign.
 	const int numcorners = 4;
@@ -85,24 +174,23 @@ void processSingleSurf(IplImage* img, IplImage* mask)
 	printf("Found %d SURF keypoints\n",ipts.size());
 
 	#ifdef SHOWIMAGES
-	drawIpoints(sign, ipts);
-	cvShowImage("trainer",sign);
-	cvWaitKey(1);
+	if (_show)
+	{
+		drawIpoints(sign, ipts);
+		cvShowImage("trainer",sign);
+		cvWaitKey(1);
+	}
 	#endif
 
-	// Add detected SURF keypoints to global database.
-	_surfpoints.insert(_surfpoints.end(),ipts.begin(),ipts.end());
-
-	#ifdef DEBUG
-		printf("%d SURF keypoints so far.\n",_surfpoints.size());
-	#endif
+	// Add detected SURF keypoints to the keypoints of this image.
+	surfpoints.insert(surfpoints.end(),ipts.begin(),ipts.end());
 
 	cvReleaseImage(&sign);
 }
 
 /* Detect the separate masks in the mask image, and feed them one-by-one
  * to the 'processSignleSurf' function*/
-void processSurf(IplImage* img, IplImage* mask)
+void processSurf(IplImage* img, IplImage* mask, IpVec& surfpoints)
 {
 	// Detect the blobs in the mask.
 	CBlobResult maskblobs = CBlobResult( mask, NULL, 0, false );
@@ -115,85 +203,120 @@ void processSurf(IplImage* img, IplImage* mask)
 	{
 		cvSet(newMask,cvScalar(0,0,0,0));
 		(maskblobs.GetBlob(i))->FillBlob(newMask,CV_RGB(255,255,255));
-		processSingleSurf(img,newMask);
+		processSingleSurf(img,newMask,surfpoints);
 	}
 	cvReleaseImage(&newMask);
 }
 
-void processFile(char* file)
+/**
+ * Trains on one image: adds its pixels to the histogram counts, and collects its SURF keypoints.
+ * _img and _mask are the loaded file and its <file>_mask.png, at the same size.
+ */
+void processFile(IplImage* _img, IplImage* _mask, BinCounts& counts, IpVec& surfpoints)
 {
-	// See if we can find a mask for this file.
-        string maskfile(file);
-        IplImage* mask = cvLoadImage((maskfile+"_mask.png").c_str(),CV_LOAD_IMAGE_GRAYSCALE);
-	if (!mask)
+	// Generate positive / negative histograms in one pass. A single image can't overflow the 32 bit counters.
+	vector<unsigned int> posHist(binsize * binsize, 0), negHist(binsize * binsize, 0);
+	countHistogramsYCrCb(_img,_mask,binsize,&posHist[0],&negHist[0]);
+
+	// Add histograms to the counts.
+	for (int i = 0; i < binsize * binsize; ++i)
 	{
-		cerr << "No mask for file " << file << " skipping..\n";
-		return;	
+		counts.pos[i] += posHist[i];
+		counts.neg[i] += negHist[i];
 	}
-	
 
-	// Load the file.
-	IplImage* img;
-	img = cvLoadImage(file);
-        if (!img)
-        {
-                cerr << "Could not load file " << file << endl;
-                exit(1);
-        }
-	cout << "Processing " << file << endl;
+	// Process SURF training.
+	processSurf(_img, _mask, surfpoints);
+}
 
-	// resize	
-	IplImage* _mask;
-	IplImage* _img; 
-	if ((XRES) && ((XRES != cvGetSize(img).width) || (YRES != cvGetSize(img).height)))
-	{
-		_mask = cvCreateImage(cvSize(XRES,YRES),IPL_DEPTH_8U,1);
-		_img = cvCreateImage(cvSize(XRES,YRES),IPL_DEPTH_8U,3);
-		cvResize(mask,_mask);
-		cvResize(img,_img);
-		cvReleaseImage(&img);
-		cvReleaseImage(&mask);
-	}
-	else
-	{
-		_mask = mask;
-		_img = img;
-	}
+/**
+ * Trains on the files on a pool of threads. Every worker adds up the histograms of its images
+ * in counts of its own, these are added to the global counts when the queue is done.
+ * SURF keypoints are added to the global database in the order of the command-line.
+ */
+class TrainQueue : public WorkQueue
+{
+	public:
+		struct Job
+		{
+			string file;
+			Prefetcher::Item* item;
+			bool hasMask;
+			IpVec surfpoints;
+		};
 
-	// Generate positive / negative histograms.
-	CvHistogram* posHist = calculateHistogram(_img,_mask,binsize,1);
-	cvNot(_mask,_mask);
-	CvHistogram* negHist = calculateHistogram(_img,_mask,binsize,1);
+		TrainQueue(int threads, Prefetcher& prefetch) : WorkQueue(threads), _prefetch(prefetch), _counts(numThreads())
+		{
+		}
 
-	// Add histograms to whole.
-	addHistogram(_posHist,posHist);
-	addHistogram(_negHist,negHist);
+		~TrainQueue()
+		{
+			for (unsigned int i = 0; i < _counts.size(); ++i)
+				::_counts.add(_counts[i]);
+		}
+
+	protected:
+		void* produce()
+		{
+			Prefetcher::Item* item = _prefetch.next();
+			if (!item)
+				return NULL;
+			Job* job = new Job;
+			job->item = item;
+			job->file = item->file;
+			return job;
+		}
+
+		void process(void* j, int worker)
+		{
+			Job* job = (Job*) j;
+			_prefetch.fetch(job->item);
+			IplImage* mask = job->item->labels.mask;
+			job->hasMask = mask != NULL;
+			if (mask && !job->item->image)
+			{
+				cerr << "Could not load file " << job->file << endl;
+				exit(1);
+			}
+			if (mask)
+				processFile(job->item->image, mask, _counts[worker], job->surfpoints);
+			_prefetch.release(job->item);
+		}
+
+		void consume(void* j)
+		{
+			Job* job = (Job*) j;
+			if (!job->hasMask)
+				cerr << "No mask for file " << job->file << " skipping..\n";
+			else
+			{
+				cout << "Processing " << job->file << endl;
+				_surfpoints.insert(_surfpoints.end(),job->surfpoints.begin(),job->surfpoints.end());
+				#ifdef DEBUG
+					printf("%d SURF keypoints so far.\n",_surfpoints.size());
+				#endif
+			}
+			delete job;
+		}
+
+	private:
+		Prefetcher& _prefetch;
+		vector<BinCounts> _counts;
+};
 
-	// Process SURF training.
-	processSurf(_img, _mask);
-	
-	// Cleanup
-	cvReleaseImage(&_img);
-	cvReleaseImage(&_mask);
-}
 void init()
 {
-	int binsizes[] = {binsize,binsize};
-        _posHist = cvCreateHist(2,binsizes, CV_HIST_ARRAY);
-        _negHist = cvCreateHist(2,binsizes, CV_HIST_ARRAY);
-	cvClearHist(_posHist);
-	cvClearHist(_negHist);
-
 	#ifdef SHOWIMAGES
-	cvNamedWindow("trainer");
+	if (_show)
+		cvNamedWindow("trainer");
 	#endif // SHOWIMAGES
 }
 
 #ifdef DEBUG
-void testSave()
+void testSave(const string& filename)
 {
 	IpVec test;
-	test = loadIpVec("_surfkeys.dat");
+	test = loadIpVec((char*) filename.c_str());
 
 	assert(test.size() == _surfpoints.size());
 	for (int i=0; i<test.size(); ++i)
@@ -206,43 +329,146 @@ void testSave()
 }
 #endif
 
-void cleanup()
+/**
+ * Save the results to files, with names starting with prefix.
+ */
+void cleanup(const string& prefix)
 {
 	// save the results to files.
-	string filename = "_posHist.hist";
-	writeHistogram(_posHist,(char*) filename.c_str());
-	filename = "_negHist.hist";
-	writeHistogram(_negHist,(char*) filename.c_str());
-	saveIpVec("_surfkeys.dat",_surfpoints);
+	writeCounts(_counts.pos,(prefix + "posHist.hist").c_str());
+	writeCounts(_counts.neg,(prefix + "negHist.hist").c_str());
+	writeModel(_counts,(prefix + "hist.model").c_str());
+	string filename = prefix + "surfkeys.dat";
+	saveIpVec((char*) filename.c_str(),_surfpoints);
 
 	#ifdef DEBUG
-	testSave();
+	testSave(filename);
 	#endif
+}
+
+/**
+ * Merge the results of earlier runs (shards), given by their prefixes, by adding up the histograms and
+ * concatenating the SURF keypoints.
+ */
+int merge(int argc, char** argv, const string& prefix)
+{
+	for (int i = optind; i < argc; ++i)
+	{
+		string shard(argv[i]);
+		if (!(readCounts(_counts.pos,(shard + "posHist.hist").c_str()) && readCounts(_counts.neg,(shard + "negHist.hist").c_str())))
+		{
+			cerr << "ERROR: " << shard << "posHist.hist and/or " << shard << "negHist.hist failed to load, or have an other number of bins." << endl;
+			return 1;
+		}
+		IpVec ipts = loadIpVec((char*) (shard + "surfkeys.dat").c_str());
+		_surfpoints.insert(_surfpoints.end(),ipts.begin(),ipts.end());
+		cout << "Merged " << shard << ", " << _surfpoints.size() << " SURF keypoints so far." << endl;
+	}
+	cleanup(prefix);
+	return 0;
+}
 
-	cvReleaseHist(&_posHist);
-	cvReleaseHist(&_negHist);
-	_posHist = NULL;
-	_negHist = NULL;
+/**
+ * Convert existing posHist.hist and negHist.hist files to a binary histogram model.
+ */
+int convert(int argc, char** argv)
+{
+	if (argc - optind != 3)
+	{
+		cerr << "Usage: " << argv[0] << " convert <posHist.hist> <negHist.hist> <hist.model>" << endl;
+		return 1;
+	}
+	CvHistogram* pos = loadHistogram(argv[optind]);
+	CvHistogram* neg = loadHistogram(argv[optind + 1]);
+	bool ok = pos && neg && HistogramModel::write(argv[optind + 2], pos, neg, 1);
+	if (!ok)
+		cerr << "ERROR: could not convert " << argv[optind] << " and " << argv[optind + 1] << " to " << argv[optind + 2] << endl;
+	if (pos)
+		cvReleaseHist(&pos);
+	if (neg)
+		cvReleaseHist(&neg);
+	return ok ? 0 : 1;
 }
 
 int main(int argc, char** argv)
 {
         if (argc < 2)
         {
-                cerr << "Usage: " << argv[0] << " <image-files>" << endl;
+                cerr << "Usage: " << argv[0] << " [-j threads] [-k depth] [-m megabytes] [-o prefix] [-0] [--list file] <image-files | ->" << endl;
+                cerr << "       " << argv[0] << " merge [-o prefix] <shard-prefixes>" << endl;
+                cerr << "       " << argv[0] << " convert <posHist.hist> <negHist.hist> <hist.model>" << endl;
+                cerr << "  -j  number of threads to train on (default 1)" << endl;
+                cerr << "  -k  number of files to load ahead of the training, 0 to load them when needed (default 4)" << endl;
+                cerr << "  -m  megabytes of memory for files loaded ahead (default 256)" << endl;
+                cerr << "  --list  read the paths of the image-files from a file, - for stdin. A - among the image-files reads them from stdin as well" << endl;
+                cerr << "  -0  paths in lists are separated by NUL characters instead of newlines" << endl;
+                cerr << "  -o  prefix of the output files (default _, giving _posHist.hist, _negHist.hist, _hist.model and _surfkeys.dat)" << endl;
                 exit(0);
         }
+	if (!strcmp(argv[1], "convert"))
+	{
+		optind = 2;
+		return convert(argc, argv);
+	}
+	bool mergeShards = !strcmp(argv[1], "merge");
+
+	// Parse command-line parameters
+	string prefix = "_";
+	int c, threads = 1, depth = 4, budget = 256;
+	char separator = '\n';
+	const char* list = NULL;
+	static struct option longOptions[] = {{"list", required_argument, NULL, 'l'}, {NULL, 0, NULL, 0}};
+	if (mergeShards)
+		optind = 2;
+	while ((c = getopt_long (argc, argv, "j:k:m:o:0", longOptions, NULL)) != -1)
+	{
+		switch(c)
+		{
+			case 'j':
+				threads = atoi(optarg);
+			break;
+			case 'k':
+				depth = atoi(optarg);
+			break;
+			case 'm':
+				budget = atoi(optarg);
+			break;
+			case '0':
+				separator = '\0';
+			break;
+			case 'l':
+				list = optarg;
+			break;
+			case 'o':
+				prefix = optarg;
+			break;
+		}
+	}
+	if (mergeShards)
+		return merge(argc, argv, prefix);
 
+	_show = (threads <= 1);
 	init();
-	// iterate through all files.
-	while (++_curFile < argc)
+	// iterate through all files, loading them and their masks depth files ahead within a budget of megabytes.
 	{
-		cvWaitKey(50);
-        	processFile(argv[_curFile]);
+		FileSource files(argv + optind, argc - optind, separator);
+		if (list && !files.setList(list))
+		{
+			cerr << "ERROR: Could not open list " << list << endl;
+			exit(1);
+		}
+		Prefetcher prefetch(files, depth, (size_t) budget << 20, MIN(depth, MAX(threads, 1)));
+		prefetch.setImageSize(cvSize(XRES,YRES), true);
+		prefetch.setMasks(cvSize(XRES,YRES), CV_LOAD_IMAGE_GRAYSCALE, true);
+		TrainQueue queue(threads, prefetch);
+		queue.run();
 	}
 
-	cleanup();
+	cleanup(prefix);
 
-	cvWaitKey(1000);
+	#ifdef SHOWIMAGES
+	if (_show)
+		cvWaitKey(1000);
+	#endif
 	return 0;
 }
@@ -0,0 +1,380 @@
+/*
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is tuner.cpp .
+ *
+ * The Initial Developer of the Original Code is Tijs Zwinkels.
+ * Portions created by the Initial Developer are Copyright (C) 2009
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * Tijs Zwinkels <opensource AT tumblecow DOT net>
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ */
+
+
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "modules/SignFinder.h"
+#include "modules/TestHandler.h"
+
+using namespace std;
+
+const unsigned int TABLE_MAGIC = 0x31544c42; // "BLT1"
+
+// Default sweep ranges, as lo:hi:step. The area is the image surface divided by the blob surface.
+const char* AREA_RANGE = "300:600:50";
+const char* SQUARENESS_RANGE = "0.50:0.90:0.05";
+const char* XYRATIO_RANGE = "0.25:0.65:0.05";
+const char* WHRATIO_RANGE = "1.5:3.5:0.25";
+
+/**
+ * A candidate blob: the features the blob classifier decides on, and the labeled blobs it corresponds with.
+ */
+struct Candidate
+{
+	double area, squareness, XYratio, WHratio;
+	vector<int> matches;
+};
+
+/**
+ * The candidates of one labeled image.
+ */
+struct ImageRecord
+{
+	int width, height;
+	int numLabels;
+	vector<Candidate> candidates;
+};
+
+/**
+ * Table
+ *
+ * Header: magic, and the minimum area (as fraction of the image) of the candidates in the table.
+ * Then per image: width, height, number of labels, number of candidates, and per candidate
+ * area, squareness, XYratio and WHratio as doubles, followed by the number of matching labels and their indices.
+ */
+template <class T> void put(FILE* f, T value) {fwrite(&value, sizeof(value), 1, f);}
+template <class T> bool get(FILE* f, T& value) {return fread(&value, sizeof(value), 1, f) == 1;}
+
+void writeImage(FILE* f, const ImageRecord& img)
+{
+	put<int>(f, img.width);
+	put<int>(f, img.height);
+	put<int>(f, img.numLabels);
+	put<int>(f, img.candidates.size());
+	for (unsigned int i = 0; i < img.candidates.size(); ++i)
+	{
+		const Candidate& c = img.candidates[i];
+		double features[4] = {c.area, c.squareness, c.XYratio, c.WHratio};
+		fwrite(features, sizeof(double), 4, f);
+		put<int>(f, c.matches.size());
+		for (unsigned int j = 0; j < c.matches.size(); ++j)
+			put<int>(f, c.matches[j]);
+	}
+}
+
+bool readImage(FILE* f, ImageRecord& img)
+{
+	int numCandidates;
+	if (!(get(f, img.width) && get(f, img.height) && get(f, img.numLabels) && get(f, numCandidates)))
+		return false;
+	img.candidates.resize(numCandidates);
+	for (int i = 0; i < numCandidates; ++i)
+	{
+		Candidate& c = img.candidates[i];
+		double features[4];
+		int numMatches;
+		if (fread(features, sizeof(double), 4, f) != 4 || !get(f, numMatches))
+			return false;
+		c.area = features[0]; c.squareness = features[1]; c.XYratio = features[2]; c.WHratio = features[3];
+		c.matches.resize(numMatches);
+		for (int j = 0; j < numMatches; ++j)
+			if (!get(f, c.matches[j]))
+				return false;
+	}
+	return true;
+}
+
+/**
+ * Dump: runs the detection once per labeled image, and writes every candidate blob to the table.
+ */
+int dump(int argc, char** argv, const char* table, double minArea)
+{
+	FILE* f = fopen(table, "wb");
+	if (!f)
+	{
+		cerr << "ERROR: Could not open " << table << " for writing." << endl;
+		return 1;
+	}
+	put<unsigned int>(f, TABLE_MAGIC);
+	put<double>(f, minArea);
+
+	SignFinder sf;
+	sf.setShowPerformance(false);
+	SignFinder::Context ctx;
+
+	int images = 0;
+	long candidates = 0;
+	for (int i = optind; i < argc; ++i)
+	{
+		CBlobResult blobs;
+		CvSize size;
+		if (!sf.findCandidates(ctx, argv[i], minArea, blobs, size))
+		{
+			cerr << "Could not load file " << argv[i] << endl;
+			continue;
+		}
+
+		ImageRecord img;
+		vector<vector<int> > matches;
+		if (!matchLabeledBlobs(blobs, size, argv[i], matches, img.numLabels))
+		{
+			cerr << "No mask for file " << argv[i] << " skipping..\n";
+			continue;
+		}
+		img.width = size.width;
+		img.height = size.height;
+
+		vector<CBlobFeatures> features;
+		blobs.GetFeatures(features);
+		img.candidates.resize(features.size());
+		for (unsigned int j = 0; j < features.size(); ++j)
+		{
+			Candidate& c = img.candidates[j];
+			c.area = features[j].area;
+			SignFinder::blobShape(features[j], c.squareness, c.XYratio, c.WHratio);
+			c.matches = matches[j];
+		}
+		writeImage(f, img);
+
+		cout << argv[i] << ": " << img.candidates.size() << " candidates, " << img.numLabels << " labels" << endl;
+		++images;
+		candidates += img.candidates.size();
+	}
+	fclose(f);
+
+	cout << "Wrote " << candidates << " candidates of " << images << " images to " << table << endl;
+	return 0;
+}
+
+/**
+ * Parses a lo:hi:step range into its values. A single number is a range of one value.
+ */
+vector<double> parseRange(const char* range)
+{
+	double lo, hi, step;
+	vector<double> values;
+	int n = sscanf(range, "%lf:%lf:%lf", &lo, &hi, &step);
+	if (n == 1)
+		values.push_back(lo);
+	else if (n == 3 && step > 0)
+		for (int i = 0; lo + i * step <= hi + step * 1e-6; ++i)
+			values.push_back(lo + i * step);
+	if (values.empty())
+	{
+		cerr << "ERROR: invalid range " << range << ", expected lo:hi:step" << endl;
+		exit(1);
+	}
+	return values;
+}
+
+struct SweepResult
+{
+	int fp, fn, multipleDetections, imagesErr;
+	SweepResult() : fp(0), fn(0), multipleDetections(0), imagesErr(0) {}
+	int errors() const {return fp + fn + multipleDetections;}
+	bool operator<(const SweepResult& other) const
+	{
+		return errors() < other.errors() || (errors() == other.errors() && imagesErr < other.imagesErr);
+	}
+};
+
+/**
+ * Counts the errors the classifier would make with the given bounds, with countDetectionErrors as checkLabeledBlobs does.
+ */
+SweepResult evaluate(const vector<ImageRecord>& images, const SignFinder::BlobBounds& bounds)
+{
+	SweepResult result;
+	vector<vector<int> > matches;
+	for (unsigned int i = 0; i < images.size(); ++i)
+	{
+		// The labels every accepted candidate corresponds with.
+		const ImageRecord& img = images[i];
+		int minPixels = bounds.minPixels(cvSize(img.width, img.height));
+		matches.clear();
+		for (unsigned int j = 0; j < img.candidates.size(); ++j)
+		{
+			const Candidate& c = img.candidates[j];
+			if (c.area >= minPixels && bounds.accepts(c.squareness, c.XYratio, c.WHratio))
+				matches.push_back(c.matches);
+		}
+
+		int fp, fn, multipleDetections;
+		countDetectionErrors(matches, img.numLabels, fp, fn, multipleDetections);
+		result.fp += fp;
+		result.fn += fn;
+		result.multipleDetections += multipleDetections;
+		if (fp || fn || multipleDetections)
+			result.imagesErr++;
+	}
+	return result;
+}
+
+void printSetting(ostream& os, const SignFinder::BlobBounds& b, const SweepResult& r)
+{
+	os << "1/" << 1. / b._minArea << " \t " << b._minSquareness << " \t " << b._minXYratio << " \t " << b._minWHratio
+	   << " \t " << r.fp << " \t " << r.fn << " \t " << r.multipleDetections << " \t " << r.imagesErr << endl;
+}
+
+/**
+ * Sweep: evaluates every combination of the bound ranges over the table.
+ */
+int sweep(const char* table, const char* areaRange, const char* squarenessRange, const char* XYratioRange, const char* WHratioRange)
+{
+	FILE* f = fopen(table, "rb");
+	unsigned int magic;
+	double minArea;
+	if (!f || !get(f, magic) || magic != TABLE_MAGIC || !get(f, minArea))
+	{
+		cerr << "ERROR: " << table << " is not a candidate table, create one with 'tuner dump'." << endl;
+		if (f)
+			fclose(f);
+		return 1;
+	}
+	vector<ImageRecord> images;
+	ImageRecord img;
+	while (readImage(f, img))
+		images.push_back(img);
+	fclose(f);
+
+	vector<double> areas = parseRange(areaRange);
+	vector<double> squareness = parseRange(squarenessRange);
+	vector<double> XYratios = parseRange(XYratioRange);
+	vector<double> WHratios = parseRange(WHratioRange);
+
+	// The table only holds blobs of at least minArea, smaller area bounds can't be evaluated.
+	for (unsigned int i = 0; i < areas.size(); ++i)
+		if (1. / areas[i] < minArea)
+		{
+			cerr << "ERROR: the table holds blobs down to 1/" << 1. / minArea << " of the image, can't evaluate an area bound of 1/" << areas[i] << endl;
+			return 1;
+		}
+
+	ofstream ofs("SweepResults.dat");
+	ofs << "# Blob classifier sweep over " << images.size() << " images." << endl;
+	ofs << "# minArea\tsquareness\tXYratio\tWHratio\tfp\tfn\tmulti\timagesErr" << endl << endl;
+
+	SignFinder::BlobBounds bounds, best;
+	SweepResult bestResult;
+	bool first = true;
+	for (unsigned int a = 0; a < areas.size(); ++a)
+		for (unsigned int s = 0; s < squareness.size(); ++s)
+			for (unsigned int x = 0; x < XYratios.size(); ++x)
+				for (unsigned int w = 0; w < WHratios.size(); ++w)
+				{
+					bounds._minArea = 1. / areas[a];
+					bounds._minSquareness = squareness[s];
+					bounds._minXYratio = XYratios[x];
+					bounds._minWHratio = WHratios[w];
+					SweepResult result = evaluate(images, bounds);
+					printSetting(ofs, bounds, result);
+					if (first || result < bestResult)
+					{
+						best = bounds;
+						bestResult = result;
+						first = false;
+					}
+				}
+	ofs.close();
+
+	cout << "# minArea\tsquareness\tXYratio\tWHratio\tfp\tfn\tmulti\timagesErr" << endl;
+	if (SignFinder::BlobBounds()._minArea >= minArea)
+	{
+		cout << "Current:  ";
+		printSetting(cout, SignFinder::BlobBounds(), evaluate(images, SignFinder::BlobBounds()));
+	}
+	cout << "Best:     ";
+	printSetting(cout, best, bestResult);
+	cout << "Use with: signFinder -b " << 1. / best._minArea << "," << best._minSquareness << "," << best._minXYratio << "," << best._minWHratio << endl;
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+        if (argc < 2 || (strcmp(argv[1], "dump") && strcmp(argv[1], "sweep")))
+        {
+                cerr << "Usage: " << argv[0] << " dump [-a area] [-t table] <image-files>" << endl;
+                cerr << "       " << argv[0] << " sweep [-t table] [-a range] [-q range] [-x range] [-w range]" << endl;
+                cerr << "  -t  candidate table (default BlobTable.dat)" << endl;
+                cerr << "  -a  dump: smallest blob to dump, as 1/area of the image (default 1000)" << endl;
+                cerr << "      sweep: range of minimum areas (default " << AREA_RANGE << ")" << endl;
+                cerr << "  -q  range of minimum squareness (default " << SQUARENESS_RANGE << ")" << endl;
+                cerr << "  -x  range of minimum x/y ratio (default " << XYRATIO_RANGE << ")" << endl;
+                cerr << "  -w  range of minimum w/h ratio (default " << WHRATIO_RANGE << ")" << endl;
+                cerr << "  A range is lo:hi:step, or a single value." << endl;
+                exit(0);
+        }
+	bool dumpStage = !strcmp(argv[1], "dump");
+
+	// Parse command-line parameters, after the stage.
+	const char* table = "BlobTable.dat";
+	const char* areaRange = dumpStage ? "1000" : AREA_RANGE;
+	const char* squarenessRange = SQUARENESS_RANGE;
+	const char* XYratioRange = XYRATIO_RANGE;
+	const char* WHratioRange = WHRATIO_RANGE;
+	int c;
+	optind = 2;
+	while ((c = getopt (argc, argv, "t:a:q:x:w:")) != -1)
+	{
+		switch(c)
+		{
+			case 't':
+				table = optarg;
+			break;
+			case 'a':
+				areaRange = optarg;
+			break;
+			case 'q':
+				squarenessRange = optarg;
+			break;
+			case 'x':
+				XYratioRange = optarg;
+			break;
+			case 'w':
+				WHratioRange = optarg;
+			break;
+		}
+	}
+
+	if (dumpStage)
+		return dump(argc, argv, table, 1. / atof(areaRange));
+	return sweep(table, areaRange, squarenessRange, XYratioRange, WHratioRange);
+}